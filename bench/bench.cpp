@@ -0,0 +1,245 @@
+#include "corpus.h"
+#include "regress.h"
+
+#include "arena.h"
+#include "file_system_cache.h"
+#include "formatters.h"
+#include "print.h"
+
+#include <uxs/cli/parser.h>
+#include <uxs/io/filebuf.h>
+
+#include <atomic>
+#include <chrono>
+#include <cstdlib>
+#include <functional>
+#include <new>
+#include <random>
+#include <thread>
+
+// Heap allocations are counted to report them per iteration; over-aligned allocations are not counted
+namespace {
+std::atomic<std::size_t> g_alloc_count{0};
+}
+
+void* operator new(std::size_t size) {
+    g_alloc_count.fetch_add(1, std::memory_order_relaxed);
+    if (void* p = std::malloc(size ? size : 1)) { return p; }
+    throw std::bad_alloc();
+}
+void operator delete(void* p) noexcept { std::free(p); }
+void operator delete(void* p, std::size_t) noexcept { std::free(p); }
+
+namespace {
+
+struct Benchmark {
+    std::string name;
+    std::size_t byte_count;            // processed by one iteration
+    std::function<std::size_t()> run;  // returns the number of processed items
+    std::string_view item_name;
+};
+
+void runBenchmark(const Benchmark& bench, std::chrono::milliseconds min_time) {
+    std::size_t item_count = bench.run();  // warm up
+    std::size_t iteration_count = 0;
+    std::size_t alloc_count = g_alloc_count.load(std::memory_order_relaxed);
+    auto start_time = std::chrono::steady_clock::now();
+    std::chrono::duration<double> elapsed{};
+    do {
+        bench.run();
+        ++iteration_count;
+        elapsed = std::chrono::steady_clock::now() - start_time;
+    } while (elapsed < min_time);
+    alloc_count = g_alloc_count.load(std::memory_order_relaxed) - alloc_count;
+
+    double seconds = elapsed.count() / static_cast<double>(iteration_count);
+    uxs::println(uxs::stdbuf::out(), "{:<40}{:>10.1f}{:>12.1f}{:>20}{:>14.1f}", bench.name, 1e6 * seconds,
+                 1e-6 * static_cast<double>(bench.byte_count) / seconds,
+                 uxs::format("{:.2f} M{}/s", 1e-6 * static_cast<double>(item_count) / seconds, bench.item_name),
+                 static_cast<double>(alloc_count) / static_cast<double>(iteration_count));
+}
+
+// Transient data is allocated from an arena which is reset for each iteration, as for each file of a run
+std::size_t lexText(std::span<const char> text, unsigned thread_count, Arena& arena) {
+    arena.reset();
+    TokenBuffer tokens(text, TextProcFlags::kAtBegOfLine, &arena);
+    tokens.lexAll(thread_count);
+    return tokens.getTokenCount();
+}
+
+std::size_t parseText(std::span<const char> text, TextProcFlags flags, Arena& arena) {
+    arena.reset();
+    TokenBuffer tokens(text, TextProcFlags::kAtBegOfLine, &arena);
+    Parser parser("bench.cpp", tokens, flags);
+    std::size_t count = 1;
+    while (!parser.parseNext().isEof()) { ++count; }
+    return count;
+}
+
+std::size_t processTextOnly(std::span<const char> text, Arena& arena) {
+    arena.reset();
+    TokenBuffer tokens(text, TextProcFlags::kAtBegOfLine, &arena);
+    FormattingContext ctx;
+    TextOutput output(text);
+    processText("bench.cpp", tokens, ctx, [](Parser&, const Parser::Token&, unsigned, TextOutput&) { return false; },
+                output);
+    return tokens.getTokenCount();
+}
+
+std::size_t formatTextWith(std::span<const char> text, const FormattingParameters& params,
+                           FileSystemCache& file_system_cache, Arena& arena) {
+    arena.reset();
+    TokenBuffer tokens(text, TextProcFlags::kAtBegOfLine, &arena);
+    FormattingContext ctx;
+    ctx.file_system_cache = &file_system_cache;
+    ctx.path_stack.emplace_back(file_system_cache.makeAbsolute("bench.cpp"));
+    ctx.definitions.assign(params.definitions);
+    TextOutput output(text);
+    formatText("bench.cpp", tokens, params, ctx, output);
+    return tokens.getTokenCount();
+}
+
+std::size_t findIncludePaths(const std::vector<std::string>& header_names, const FormattingParameters& params,
+                             FileSystemCache& file_system_cache) {
+    FormattingContext ctx;
+    ctx.file_system_cache = &file_system_cache;
+    ctx.path_stack.emplace_back(file_system_cache.makeAbsolute("bench.cpp"));
+    std::size_t found_count = 0;
+    for (const auto& header_name : header_names) {
+        found_count += !findIncludePath(header_name, IncludeBrackets::kDoubleQuotes, params, ctx).first.empty();
+    }
+    if (found_count != header_names.size()) { throw std::runtime_error("include graph header is not found"); }
+    return header_names.size();
+}
+
+}  // namespace
+
+int main(int argc, char** argv) {
+    bool show_help = false;
+    std::string filter;
+    std::size_t corpus_size = 1024;
+    unsigned min_time = 500;
+    std::string corpus_dir, golden_dir, baseline_file_name, tool_path;
+    RegressionOptions regression;
+
+    auto cli = uxs::cli::command(argv[0])
+               << uxs::cli::overview("Microbenchmarks of code-format lexer, fixers and include resolution")
+               << (uxs::cli::option({"--filter"}) & uxs::cli::value("<text>", filter)) %
+                      "Run only benchmarks with names containing the text."
+               << (uxs::cli::option({"--size"}) & uxs::cli::value("<KiB>", corpus_size)) %
+                      "Size of each synthetic source, 1024 by default."
+               << (uxs::cli::option({"--min-time"}) & uxs::cli::value("<ms>", min_time)) %
+                      "Minimal run time of each benchmark, 500 by default."
+               << (uxs::cli::option({"--regress"}) & uxs::cli::value("<dir>", corpus_dir)) %
+                      "Instead of microbenchmarks run the tool over the corpus\n"
+                      "in the directory with each combination of fixes,\n"
+                      "compare outputs with golden ones."
+               << (uxs::cli::option({"--golden"}) & uxs::cli::value("<dir>", golden_dir)) %
+                      "Directory of golden outputs."
+               << (uxs::cli::option({"--baselines"}) & uxs::cli::value("<file>", baseline_file_name)) %
+                      "Compare time and peak memory with baselines\n"
+                      "of the file, it is created if missing."
+               << (uxs::cli::option({"--tool"}) & uxs::cli::value("<file>", tool_path)) %
+                      "The tool to run, `code-format` next to this one by default."
+               << uxs::cli::option({"--update-golden"}).set(regression.update_golden) %
+                      "Replace golden outputs and given baselines."
+               << (uxs::cli::option({"--repeat"}) & uxs::cli::value("<count>", regression.repeat_count)) %
+                      "Number of runs of each combination, 3 by default."
+               << (uxs::cli::option({"--tolerance"}) & uxs::cli::value("<percent>", regression.tolerance)) %
+                      "Tolerance of time and peak memory, 20 by default."
+               << uxs::cli::option({"-h", "--help"}).set(show_help) % "Display this information.";
+
+    auto parse_result = cli->parse(argc, argv);
+    if (show_help) {
+        uxs::stdbuf::out().write(parse_result.node->get_command()->make_man_page(uxs::cli::text_coloring::colored));
+        return 0;
+    } else if (parse_result.status != uxs::cli::parsing_status::ok) {
+        printError("invalid command line argument");
+        return -1;
+    }
+
+    if (!corpus_dir.empty()) {
+        if (golden_dir.empty()) {
+            printError("golden directory is not specified");
+            return -1;
+        }
+        regression.corpus_dir = corpus_dir;
+        regression.golden_dir = golden_dir;
+        regression.baseline_file_path = baseline_file_name;
+        regression.tool_path = !tool_path.empty() ? std::filesystem::path(tool_path) :
+                                                    std::filesystem::absolute(argv[0]).parent_path() / "code-format";
+        return runRegression(regression) ? 0 : -1;
+    }
+
+    const std::size_t size = corpus_size * 1024;
+    const std::vector<std::pair<std::string_view, std::string>> corpus = {
+        {"deep-nesting", generateDeepNesting(size, 24)},
+        {"long-comments", generateLongComments(size)},
+        {"macro-heavy", generateMacroHeavyHeader(size)},
+        {"mixed", generateMixedSource(size)},
+    };
+
+    // Include graph of 4 levels of 32 headers, the headers of the deepest level take most directory probes
+    constexpr unsigned kGraphWidth = 32, kGraphDepth = 4;
+    auto graph_dir = std::filesystem::temp_directory_path() /
+                     uxs::format("code-format-bench-{:x}", std::random_device{}());
+    FormattingParameters graph_params;
+    for (auto& dir : generateIncludeGraph(graph_dir, kGraphWidth, kGraphDepth)) {
+        graph_params.include_dirs.emplace_back(std::move(dir), IncludePathType::kCustom);
+    }
+    std::vector<std::string> header_names;
+    for (unsigned level = 0; level != kGraphDepth; ++level) {
+        for (unsigned n = 0; n != kGraphWidth; ++n) { header_names.emplace_back(makeIncludeGraphHeaderName(level, n)); }
+    }
+
+    Arena arena;
+    FileSystemCache file_system_cache;
+    const unsigned lex_thread_count = std::max(1u, std::thread::hardware_concurrency());
+    FormattingParameters single_statement_params;
+    single_statement_params.fix_single_statement = true;
+
+    std::vector<Benchmark> benchmarks;
+    for (const auto& [name, text] : corpus) {
+        std::span<const char> src_text = text;
+        benchmarks.push_back({uxs::format("lex/{}", name), text.size(),
+                              [src_text, &arena] { return lexText(src_text, 1, arena); }, "tok"});
+        benchmarks.push_back({uxs::format("lex-parallel/{}", name), text.size(),
+                              [src_text, lex_thread_count, &arena] {
+                                  return lexText(src_text, lex_thread_count, arena);
+                              },
+                              "tok"});
+        benchmarks.push_back({uxs::format("parse-next/{}", name), text.size(),
+                              [src_text, &arena] { return parseText(src_text, TextProcFlags::kNone, arena); }, "tok"});
+        benchmarks.push_back({uxs::format("process-text/{}", name), text.size(),
+                              [src_text, &arena] { return processTextOnly(src_text, arena); }, "tok"});
+        benchmarks.push_back({uxs::format("fix-single-statement/{}", name), text.size(),
+                              [src_text, &single_statement_params, &file_system_cache, &arena] {
+                                  return formatTextWith(src_text, single_statement_params, file_system_cache, arena);
+                              },
+                              "tok"});
+        benchmarks.push_back({uxs::format("fix-id-naming/{}", name), text.size(),
+                              [src_text, &arena] { return parseText(src_text, TextProcFlags::kFixIdNaming, arena); },
+                              "tok"});
+    }
+    benchmarks.push_back({"find-include-path/warm", 0,
+                          [&header_names, &graph_params, &file_system_cache] {
+                              return findIncludePaths(header_names, graph_params, file_system_cache);
+                          },
+                          "lookup"});
+    benchmarks.push_back({"find-include-path/cold", 0,
+                          [&header_names, &graph_params] {
+                              FileSystemCache cold_cache;
+                              return findIncludePaths(header_names, graph_params, cold_cache);
+                          },
+                          "lookup"});
+
+    uxs::println(uxs::stdbuf::out(), "{:<40}{:>10}{:>12}{:>20}{:>14}", "benchmark", "us/iter", "MB/s", "items/s",
+                 "allocs/iter");
+    for (const auto& bench : benchmarks) {
+        if (bench.name.find(filter) != std::string::npos) { runBenchmark(bench, std::chrono::milliseconds(min_time)); }
+    }
+
+    std::error_code ec;
+    std::filesystem::remove_all(graph_dir, ec);
+    return 0;
+}
@@ -0,0 +1,102 @@
+#include "corpus.h"
+
+#include <uxs/format.h>
+
+#include <fstream>
+
+std::string generateDeepNesting(std::size_t size, unsigned depth) {
+    std::string text;
+    for (unsigned func = 0; text.size() < size; ++func) {
+        text += uxs::format("int nested_{}(int a, int b) {{\n", func);
+        std::string indent = "    ";
+        for (unsigned level = 0; level != depth; ++level, indent += "    ") {
+            switch (level % 3) {
+                case 0: text += uxs::format("{}if (a > {}) {{\n", indent, level); break;
+                case 1: {
+                    text += uxs::format("{}for (int i{} = 0; i{} < b; ++i{}) {{\n", indent, level, level, level);
+                } break;
+                default: text += uxs::format("{}while (b-- > {}) {{\n", indent, level); break;
+            }
+            if (level % 2) {
+                text += uxs::format("{}    if (a == b) return {};\n", indent, level);
+            } else {
+                text += uxs::format("{}    if (a < b) {{ a += {}; }} else b -= a;\n", indent, level);
+            }
+        }
+        while (indent.size() > 4) {
+            indent.resize(indent.size() - 4);
+            text += indent + "}\n";
+        }
+        text += "    return a + b;\n}\n\n";
+    }
+    return text;
+}
+
+std::string generateLongComments(std::size_t size) {
+    std::string text;
+    for (unsigned n = 0; text.size() < size; ++n) {
+        text += "/*\n";
+        for (unsigned line = 0; line != 24; ++line) {
+            text += uxs::format(" * Line {} of a long block comment describing declaration {}\n", line, n);
+        }
+        text += " */\n";
+        for (unsigned line = 0; line != 8; ++line) {
+            text += uxs::format("// Line {} of a line comment which is continued on the next line of the file\n", line);
+        }
+        text += uxs::format("extern int declaration_{};  // trailing comment\n\n", n);
+    }
+    return text;
+}
+
+std::string generateMacroHeavyHeader(std::size_t size) {
+    std::string text = "#ifndef MACRO_HEAVY_H\n#define MACRO_HEAVY_H\n\n";
+    for (unsigned n = 0; text.size() < size; ++n) {
+        text += uxs::format("#define CONFIG_{} {}\n", n, n);
+        text += uxs::format("#define CALL_{}(x, y) \\\n    do {{ \\\n", n);
+        text += uxs::format("        if ((x) > (y)) f_{}(x); \\\n    }} while (0)\n", n);
+        text += uxs::format("#if defined(CONFIG_{})\n#    define HAS_FEATURE_{} 1\n", n, n);
+        text += uxs::format("#elif defined(CONFIG_{})\n#    define HAS_FEATURE_{} 0\n#else\n", n + 1, n);
+        text += uxs::format("#    include \"feature_{}.h\"\n#endif\n", n);
+        text += uxs::format("#ifdef HAS_FEATURE_{}\nint feature_{}(int arg) {{ CALL_{}(arg, 0); return arg; }}\n", n,
+                            n, n);
+        text += "#endif\n\n";
+    }
+    return text += "#endif  // MACRO_HEAVY_H\n";
+}
+
+std::string generateMixedSource(std::size_t size) {
+    std::string text = "#include <vector>\n#include \"mixed.h\"\n\n";
+    for (unsigned n = 0; text.size() < size; ++n) {
+        text += uxs::format("class MixedClass{} {{\n public:\n", n);
+        text += uxs::format("    int getValue{}() const {{ return m_value; }}\n", n);
+        text += "    void setValue(int newValue) {\n        if (newValue < 0) newValue = 0;\n";
+        text += "        m_value = newValue;\n    }\n\n private:\n    int m_value = 0;\n};\n\n";
+        text += uxs::format("int process{}(const std::vector<int>& inputValues) {{\n", n);
+        text += "    int totalSum = 0;\n    for (int itemValue : inputValues)\n";
+        text += "        if (itemValue > 0) totalSum += itemValue;\n        else if (itemValue < -10) totalSum -= 1;\n";
+        text += "        else totalSum += 2;\n    return totalSum;\n}\n\n";
+    }
+    return text;
+}
+
+std::string makeIncludeGraphHeaderName(unsigned level, unsigned n) { return uxs::format("header_{}_{}.h", level, n); }
+
+std::vector<std::filesystem::path> generateIncludeGraph(const std::filesystem::path& dir, unsigned width,
+                                                        unsigned depth) {
+    std::vector<std::filesystem::path> include_dirs;
+    for (unsigned level = 0; level != depth; ++level) {
+        auto& level_dir = include_dirs.emplace_back(dir / uxs::format("level_{}", level));
+        std::filesystem::create_directories(level_dir);
+        for (unsigned n = 0; n != width; ++n) {
+            std::ofstream header(level_dir / makeIncludeGraphHeaderName(level, n));
+            header << "#pragma once\n";
+            if (level + 1 != depth) {
+                for (unsigned next = 0; next != width; ++next) {
+                    header << "#include \"" << makeIncludeGraphHeaderName(level + 1, next) << "\"\n";
+                }
+            }
+            header << "int function_" << level << '_' << n << "();\n";
+        }
+    }
+    return include_dirs;
+}
@@ -0,0 +1,27 @@
+#pragma once
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Synthetic sources for microbenchmarks; each generator repeats its pattern until the text is at least `size` bytes
+
+// Functions with `if`-`else` and loop statements nested `depth` levels, every other body is a single statement
+std::string generateDeepNesting(std::size_t size, unsigned depth);
+
+// Declarations interleaved with long block and line comments
+std::string generateLongComments(std::size_t size);
+
+// Header with include guard, macro definitions and conditional sections depending on them
+std::string generateMacroHeavyHeader(std::size_t size);
+
+// Ordinary code with identifiers which need naming fixes and single-statement blocks
+std::string generateMixedSource(std::size_t size);
+
+// Writes a graph of headers in `dir`: `depth` levels of `width` headers in their own directories, each header includes
+// all headers of the next level. Returns include directories of the levels, the top level first
+std::vector<std::filesystem::path> generateIncludeGraph(const std::filesystem::path& dir, unsigned width,
+                                                        unsigned depth);
+
+// Name of header `n` of level `level` of the include graph
+std::string makeIncludeGraphHeaderName(unsigned level, unsigned n);
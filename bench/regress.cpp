@@ -0,0 +1,231 @@
+#include "regress.h"
+
+#include "input_files.h"
+#include "mapped_file.h"
+#include "print.h"
+
+#include <uxs/io/filebuf.h>
+
+#include <array>
+#include <chrono>
+#include <fstream>
+#include <map>
+#include <optional>
+#include <random>
+
+#if defined(_WIN32)
+#    include <cstdlib>
+#else
+#    include <fcntl.h>
+#    include <spawn.h>
+#    include <sys/resource.h>
+#    include <sys/wait.h>
+#    include <unistd.h>
+
+#    include <cerrno>
+
+extern char** environ;
+#endif
+
+namespace {
+
+constexpr std::array<std::pair<std::string_view, std::string_view>, 5> kFixes = {{
+    {"--fix-file-ending", "ending"},
+    {"--fix-single-statement", "single-statement"},
+    {"--fix-id-naming", "id-naming"},
+    {"--fix-pragma-once", "pragma-once"},
+    {"--remove-already-included", "already-included"},
+}};
+
+struct RunResult {
+    bool success = false;
+    double time_ms = 0.;
+    std::size_t peak_rss = 0;  // in KiB, 0 if unknown
+};
+
+std::string makeCombinationName(unsigned fixes) {
+    std::string name;
+    for (unsigned n = 0; n != kFixes.size(); ++n) {
+        if (!(fixes & (1u << n))) { continue; }
+        if (!name.empty()) { name += '+'; }
+        name += kFixes[n].second;
+    }
+    return !name.empty() ? name : "none";
+}
+
+// Runs the tool with `args`, its standard output is dropped
+RunResult runTool(const std::filesystem::path& tool_path, const std::vector<std::string>& args) {
+    RunResult result;
+    auto start_time = std::chrono::steady_clock::now();
+#if defined(_WIN32)
+    std::string command = uxs::format("\"\"{}\"", tool_path.string());
+    for (const auto& arg : args) { command += uxs::format(" \"{}\"", arg); }
+    result.success = std::system((command + " > NUL\"").c_str()) == 0;
+#else
+    std::vector<std::string> argv_strings{tool_path.string()};
+    argv_strings.insert(argv_strings.end(), args.begin(), args.end());
+    std::vector<char*> argv;
+    for (auto& arg : argv_strings) { argv.push_back(arg.data()); }
+    argv.push_back(nullptr);
+
+    posix_spawn_file_actions_t actions;
+    ::posix_spawn_file_actions_init(&actions);
+    ::posix_spawn_file_actions_addopen(&actions, STDOUT_FILENO, "/dev/null", O_WRONLY, 0);
+    pid_t pid = 0;
+    if (::posix_spawn(&pid, argv[0], &actions, nullptr, argv.data(), environ) == 0) {
+        int status = 0;
+        rusage usage{};
+        while (::wait4(pid, &status, 0, &usage) < 0 && errno == EINTR) {}
+        result.success = WIFEXITED(status) && WEXITSTATUS(status) == 0;
+        result.peak_rss = static_cast<std::size_t>(usage.ru_maxrss);  // in KiB on Linux
+    }
+    ::posix_spawn_file_actions_destroy(&actions);
+#endif
+    result.time_ms = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - start_time).count();
+    return result;
+}
+
+std::optional<std::string> readFile(const std::filesystem::path& file_path) {
+    MappedFile file;
+    if (!file.open(file_path)) { return std::nullopt; }
+    return std::string(file.getData().data(), file.getData().size());
+}
+
+// Baselines are stored as lines `<combination> <time ms> <peak KiB>`
+using Baselines = std::map<std::string, std::pair<double, std::size_t>>;
+
+Baselines loadBaselines(const std::filesystem::path& file_path) {
+    Baselines baselines;
+    std::ifstream in(file_path);
+    std::string name;
+    std::pair<double, std::size_t> baseline;
+    while (in >> name >> baseline.first >> baseline.second) { baselines.emplace(name, baseline); }
+    return baselines;
+}
+
+bool storeBaselines(const std::filesystem::path& file_path, const Baselines& baselines) {
+    std::ofstream out(file_path);
+    for (const auto& [name, baseline] : baselines) {
+        out << uxs::format("{} {:.3f} {}\n", name, baseline.first, baseline.second);
+    }
+    return !!out;
+}
+
+}  // namespace
+
+bool runRegression(const RegressionOptions& options) {
+    const auto corpus_dir = std::filesystem::absolute(options.corpus_dir).lexically_normal();
+    std::vector<std::string> corpus_files;
+    if (!collectInputFiles({corpus_dir.string()}, corpus_files)) {
+        printError("no sources found in corpus `{}`", corpus_dir.generic_string());
+        return false;
+    }
+    std::vector<std::filesystem::path> relative_paths;
+    for (const auto& file_name : corpus_files) {
+        auto file_path = std::filesystem::absolute(file_name).lexically_normal();
+        relative_paths.emplace_back(file_path.lexically_relative(corpus_dir));
+    }
+
+    // Baselines depend on the machine and the build, so they are not kept with golden outputs
+    const auto& baseline_file_path = options.baseline_file_path;
+    std::error_code ec;
+    const bool update_baselines = !baseline_file_path.empty() &&
+                                  (options.update_golden || !std::filesystem::exists(baseline_file_path, ec));
+    Baselines baselines;
+    if (!baseline_file_path.empty() && !update_baselines) { baselines = loadBaselines(baseline_file_path); }
+
+    auto work_dir = std::filesystem::temp_directory_path() /
+                    uxs::format("code-format-regress-{:x}", std::random_device{}());
+    const double limit = 1. + 0.01 * options.tolerance;
+    bool success = true;
+
+    uxs::println(uxs::stdbuf::out(), "{:<64}{:>12}{:>12}", "fixes", "time, ms", "peak, KiB");
+    for (unsigned fixes = 0; fixes != 1u << kFixes.size(); ++fixes) {
+        auto name = makeCombinationName(fixes);
+        std::vector<std::string> args;
+        for (unsigned n = 0; n != kFixes.size(); ++n) {
+            if (fixes & (1u << n)) { args.emplace_back(kFixes[n].first); }
+        }
+        args.push_back(work_dir.string());
+
+        // The tool fixes files in place, so each run gets a fresh copy of the corpus
+        RunResult best;
+        for (unsigned n = 0; n != std::max(1u, options.repeat_count); ++n) {
+            std::error_code ec;
+            std::filesystem::remove_all(work_dir, ec);
+            std::filesystem::copy(corpus_dir, work_dir, std::filesystem::copy_options::recursive, ec);
+            if (ec) {
+                printError("could not copy corpus to `{}`", work_dir.generic_string());
+                return false;
+            }
+            auto result = runTool(options.tool_path, args);
+            if (!result.success) {
+                best.success = false;
+                break;
+            }
+            if (n == 0 || result.time_ms < best.time_ms) { best.time_ms = result.time_ms; }
+            best.peak_rss = std::max(best.peak_rss, result.peak_rss);
+            best.success = true;
+        }
+
+        bool is_ok = best.success;
+        if (!best.success) { printError("{}: `{}` failed", name, options.tool_path.generic_string()); }
+
+        const auto golden_dir = options.golden_dir / name;
+        if (best.success && options.update_golden) {
+            std::error_code ec;
+            std::filesystem::remove_all(golden_dir, ec);
+            for (const auto& relative_path : relative_paths) {
+                std::filesystem::create_directories((golden_dir / relative_path).parent_path(), ec);
+                std::filesystem::copy_file(work_dir / relative_path, golden_dir / relative_path, ec);
+                if (ec) {
+                    printError("could not write golden output `{}`", (golden_dir / relative_path).generic_string());
+                    is_ok = false;
+                }
+            }
+        } else if (best.success) {
+            for (const auto& relative_path : relative_paths) {
+                auto output = readFile(work_dir / relative_path);
+                auto golden = readFile(golden_dir / relative_path);
+                if (!golden) {
+                    printError("{}: no golden output for `{}`", name, relative_path.generic_string());
+                    is_ok = false;
+                } else if (!output || *output != *golden) {
+                    printError("{}: output for `{}` differs from golden", name, relative_path.generic_string());
+                    is_ok = false;
+                }
+            }
+        }
+
+        if (best.success && update_baselines) {
+            baselines[name] = {best.time_ms, best.peak_rss};
+        } else if (best.success && !baseline_file_path.empty()) {
+            if (auto it = baselines.find(name); it == baselines.end()) {
+                printWarning("{}: no baseline", name);
+            } else {
+                const auto& [baseline_time, baseline_rss] = it->second;
+                if (best.time_ms > limit * baseline_time) {
+                    printError("{}: {:.1f} ms is out of tolerance of baseline {:.1f} ms", name, best.time_ms,
+                               baseline_time);
+                    is_ok = false;
+                }
+                if (best.peak_rss > limit * static_cast<double>(baseline_rss)) {
+                    printError("{}: peak of {} KiB is out of tolerance of baseline {} KiB", name, best.peak_rss,
+                               baseline_rss);
+                    is_ok = false;
+                }
+            }
+        }
+
+        uxs::println(uxs::stdbuf::out(), "{:<64}{:>12.1f}{:>12}  {}", name, best.time_ms, best.peak_rss,
+                     is_ok ? "ok" : "FAILED");
+        success &= is_ok;
+    }
+
+    std::filesystem::remove_all(work_dir, ec);
+    if (update_baselines && !storeBaselines(baseline_file_path, baselines)) {
+        printError("could not write baselines `{}`", baseline_file_path.generic_string());
+        return false;
+    }
+    return success;
+}
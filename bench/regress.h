@@ -0,0 +1,19 @@
+#pragma once
+
+#include <filesystem>
+
+struct RegressionOptions {
+    std::filesystem::path tool_path;   // built `code-format`
+    std::filesystem::path corpus_dir;  // sources which are fixed
+    std::filesystem::path golden_dir;  // golden outputs
+    std::filesystem::path baseline_file_path;  // time and peak memory of a build on this machine, optional
+    bool update_golden = false;
+    unsigned repeat_count = 3;  // the best time of runs is taken
+    unsigned tolerance = 20;    // in percent of baseline time and peak memory
+};
+
+// Runs the tool over a copy of the corpus for each combination of fixes. Outputs are compared with golden outputs byte
+// by byte. If a baseline file is given, the best wall time and peak memory of the runs are compared with its
+// baselines; a missing file is created. With `update_golden` golden outputs and given baselines are replaced. Returns
+// `false` if anything differs or is out of tolerance
+bool runRegression(const RegressionOptions& options);
@@ -0,0 +1,38 @@
+#pragma once
+
+#include <memory>
+#include <memory_resource>
+
+// Monotonic memory resource for transient allocations made while a file is processed. Deallocation does nothing, all
+// memory is released at once by `reset()`. The initial block is kept, so an arena reused for the next file takes
+// nothing from the heap until the file outgrows this block.
+class Arena : public std::pmr::memory_resource {
+ public:
+    explicit Arena(std::size_t initial_size = kDefaultInitialSize)
+        : initial_block_(std::make_unique_for_overwrite<char[]>(initial_size)),
+          buffer_(initial_block_.get(), initial_size) {}
+    Arena(const Arena&) = delete;
+    Arena& operator=(const Arena&) = delete;
+
+    std::size_t getAllocCount() const { return alloc_count_; }
+    std::size_t getAllocSize() const { return alloc_size_; }
+    void reset() {
+        buffer_.release();
+        alloc_count_ = alloc_size_ = 0;
+    }
+
+ private:
+    static constexpr std::size_t kDefaultInitialSize = 256 * 1024;
+
+    std::unique_ptr<char[]> initial_block_;
+    std::pmr::monotonic_buffer_resource buffer_;
+    std::size_t alloc_count_ = 0;
+    std::size_t alloc_size_ = 0;
+
+    void* do_allocate(std::size_t size, std::size_t alignment) override {
+        ++alloc_count_, alloc_size_ += size;
+        return buffer_.allocate(size, alignment);
+    }
+    void do_deallocate(void*, std::size_t, std::size_t) override {}
+    bool do_is_equal(const std::pmr::memory_resource& other) const noexcept override { return this == &other; }
+};
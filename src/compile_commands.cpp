@@ -0,0 +1,140 @@
+#include "compile_commands.h"
+
+#include "print.h"
+
+#include <uxs/db/json.h>
+#include <uxs/io/filebuf.h>
+
+#include <algorithm>
+#include <array>
+#include <optional>
+
+namespace {
+
+// Splits a command line as a POSIX shell does, without expansions
+std::vector<std::string> splitCommand(std::string_view command) {
+    std::vector<std::string> args;
+    std::string arg;
+    bool has_arg = false;
+    char quote = '\0';
+    for (std::size_t n = 0; n != command.size(); ++n) {
+        char ch = command[n];
+        if (quote == '\'') {
+            if (ch == '\'') {
+                quote = '\0';
+            } else {
+                arg.push_back(ch);
+            }
+        } else if (ch == '\\' && n + 1 != command.size() &&
+                   (quote == '\0' || std::string_view("\"\\$`").find(command[n + 1]) != std::string_view::npos)) {
+            arg.push_back(command[++n]), has_arg = true;
+        } else if (quote == '"') {
+            if (ch == '"') {
+                quote = '\0';
+            } else {
+                arg.push_back(ch);
+            }
+        } else if (ch == '\'' || ch == '"') {
+            quote = ch, has_arg = true;
+        } else if (ch == ' ' || ch == '\t' || ch == '\n' || ch == '\r') {
+            if (has_arg) { args.emplace_back(std::move(arg)), arg.clear(), has_arg = false; }
+        } else {
+            arg.push_back(ch), has_arg = true;
+        }
+    }
+    if (has_arg) { args.emplace_back(std::move(arg)); }
+    return args;
+}
+
+void parseArguments(const std::vector<std::string>& args, const std::filesystem::path& dir, CompileCommand& command) {
+    enum class OptionType { kDefine = 0, kUndefine, kQuoteDir, kDir, kSystemDir, kAfterDir };
+    static constexpr std::array<std::pair<std::string_view, OptionType>, 6> options = {{
+        {"-D", OptionType::kDefine},
+        {"-U", OptionType::kUndefine},
+        {"-iquote", OptionType::kQuoteDir},
+        {"-I", OptionType::kDir},
+        {"-isystem", OptionType::kSystemDir},
+        {"-idirafter", OptionType::kAfterDir},
+    }};
+
+    // Directories are searched in this order: `-iquote`, `-I`, `-isystem`, `-idirafter`
+    std::array<std::vector<std::filesystem::path>, 4> dirs;
+    for (std::size_t n = 1; n < args.size(); ++n) {
+        std::string_view arg = args[n];
+        auto it = std::find_if(options.begin(), options.end(),
+                               [arg](const auto& option) { return arg.starts_with(option.first); });
+        if (it == options.end()) { continue; }
+        std::string_view value = arg.substr(it->first.size());
+        if (value.empty()) {
+            if (n + 1 == args.size()) { break; }
+            value = args[++n];
+        }
+        switch (it->second) {
+            case OptionType::kDefine: command.definitions.emplace_back(value.substr(0, value.find('='))); break;
+            case OptionType::kUndefine: std::erase(command.definitions, value); break;
+            default: {
+                dirs[static_cast<unsigned>(it->second) - static_cast<unsigned>(OptionType::kQuoteDir)].emplace_back(
+                    (dir / value).lexically_normal());
+            } break;
+        }
+    }
+
+    for (unsigned n = 0; n != dirs.size(); ++n) {
+        for (auto& include_dir : dirs[n]) {
+            command.include_dirs.emplace_back(std::move(include_dir),
+                                              n < 2 ? IncludePathType::kCustom : IncludePathType::kSystem);
+        }
+    }
+}
+
+}  // namespace
+
+bool readCompileCommands(const std::filesystem::path& file_path, std::vector<CompileCommand>& commands) {
+    uxs::filebuf ifile(file_path.c_str(), "r");
+    if (!ifile) {
+        printError("could not open compilation database `{}`", file_path.generic_string());
+        return false;
+    }
+
+    uxs::db::value root;
+    try {
+        root = uxs::db::json::reader(ifile).read();
+    } catch (const std::exception& e) {
+        printError("{}: invalid compilation database: {}", file_path.generic_string(), e.what());
+        return false;
+    }
+    if (!root.is_array()) {
+        printError("{}: invalid compilation database", file_path.generic_string());
+        return false;
+    }
+
+    auto get_string = [](const uxs::db::value& entry, std::string_view name) -> std::optional<std::string> {
+        if (!entry.is_record() || !entry.contains(name) || !entry[name].is_string()) { return std::nullopt; }
+        return entry[name].as_string();
+    };
+
+    for (const auto& entry : root.as_array()) {
+        auto directory = get_string(entry, "directory");
+        auto file_name = get_string(entry, "file");
+        if (!directory || !file_name) {
+            printWarning("{}: compilation database entry without `directory` or `file` is skipped",
+                         file_path.generic_string());
+            continue;
+        }
+
+        std::filesystem::path dir = std::filesystem::absolute(*directory);
+        std::vector<std::string> args;
+        if (entry.contains("arguments") && entry["arguments"].is_array()) {
+            for (const auto& arg : entry["arguments"].as_array()) {
+                if (arg.is_string()) { args.emplace_back(arg.as_string()); }
+            }
+        } else if (auto command = get_string(entry, "command"); command) {
+            args = splitCommand(*command);
+        }
+
+        auto& command = commands.emplace_back();
+        command.file_path = (dir / *file_name).lexically_normal();
+        parseArguments(args, dir, command);
+    }
+    return true;
+}
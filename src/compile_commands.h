@@ -0,0 +1,19 @@
+#pragma once
+
+#include "formatters.h"
+
+#include <filesystem>
+#include <string>
+#include <vector>
+
+// Definitions and include directories of a translation unit taken from its compile command
+struct CompileCommand {
+    std::filesystem::path file_path;  // absolute and normal
+    std::vector<std::string> definitions;
+    std::vector<std::pair<std::filesystem::path, IncludePathType>> include_dirs;
+};
+
+// Reads a JSON compilation database (`compile_commands.json`); `-D`, `-U`, `-I`, `-iquote`, `-isystem` and
+// `-idirafter` options are taken from `arguments` or `command` of each entry, relative paths are resolved from its
+// `directory`
+bool readCompileCommands(const std::filesystem::path& file_path, std::vector<CompileCommand>& commands);
@@ -0,0 +1,26 @@
+#include "definition_table.h"
+
+void DefinitionTable::assign(const std::vector<std::string>& names) {
+    restore(0);
+    for (const auto& name : names) { add(name); }
+}
+
+bool DefinitionTable::contains(std::string_view name) {
+    ++lookup_count_;
+    auto it = symbols_.find(name);
+    return it != symbols_.end() && definition_counts_[it->second] != 0;
+}
+
+void DefinitionTable::add(std::string_view name) {
+    auto it = symbols_.find(name);
+    if (it == symbols_.end()) {
+        it = symbols_.emplace(name, static_cast<unsigned>(definition_counts_.size())).first;
+        definition_counts_.push_back(0);
+    }
+    ++definition_counts_[it->second];
+    log_.push_back(it->second);
+}
+
+void DefinitionTable::restore(std::size_t size) {
+    for (; log_.size() > size; log_.pop_back()) { --definition_counts_[log_.back()]; }
+}
@@ -0,0 +1,31 @@
+#pragma once
+
+#include <string>
+#include <string_view>
+#include <unordered_map>
+#include <vector>
+
+// Set of defined names: each name is interned to a symbol once, the set keeps the count of definitions for each symbol
+// and the log of definitions, so it can be cheaply rolled back to any of its earlier sizes
+class DefinitionTable {
+ public:
+    void assign(const std::vector<std::string>& names);
+    bool contains(std::string_view name);
+    void add(std::string_view name);
+    std::size_t getSize() const { return log_.size(); }
+    void restore(std::size_t size);
+
+    std::size_t getLookupCount() const { return lookup_count_; }
+    std::size_t getSymbolCount() const { return symbols_.size(); }
+
+ private:
+    struct Hash {
+        using is_transparent = void;
+        std::size_t operator()(std::string_view s) const { return std::hash<std::string_view>{}(s); }
+    };
+
+    std::unordered_map<std::string, unsigned, Hash, std::equal_to<>> symbols_;
+    std::vector<unsigned> definition_counts_;
+    std::vector<unsigned> log_;
+    std::size_t lookup_count_ = 0;
+};
@@ -0,0 +1,56 @@
+#include "file_system_cache.h"
+
+#include <uxs/string_cvt.h>
+
+#include <mutex>
+
+namespace {
+std::string makeEntryName(const std::filesystem::path& name) {
+    std::string s = name.string();
+#if defined(_WIN32) || defined(__APPLE__)
+    // Case-insensitive file systems
+    for (char& ch : s) { ch = uxs::to_lower(ch); }
+#endif
+    return s;
+}
+}  // namespace
+
+bool FileSystemCache::exists(const std::filesystem::path& abs_path) {
+    ++probe_count_;
+    auto name = abs_path.filename();
+    if (name.empty()) { return getListing(abs_path.parent_path())->is_dir; }
+    return getListing(abs_path.parent_path())->names.count(makeEntryName(name)) != 0;
+}
+
+std::shared_ptr<const FileSystemCache::Listing> FileSystemCache::getListing(const std::filesystem::path& dir) {
+    auto key = dir.generic_string();
+    const unsigned generation = generation_;
+    std::error_code ec;
+    {
+        std::shared_lock lock(mutex_);
+        auto it = listings_.find(key);
+        if (it != listings_.end()) {
+            const auto& listing = it->second;
+            if (listing->generation.exchange(generation) == generation) { return listing; }
+            ++fs_call_count_;
+            if (std::filesystem::last_write_time(dir, ec) == listing->dir_time) { return listing; }
+        }
+    }
+
+    ++listing_count_;
+    fs_call_count_ += 2;  // modification time and directory walk
+    auto listing = std::make_shared<Listing>();
+    listing->dir_time = std::filesystem::last_write_time(dir, ec);
+    listing->generation = generation;
+    for (std::filesystem::directory_iterator it(dir, ec), end; !ec && it != end; it.increment(ec)) {
+        listing->is_dir = true;
+        listing->names.emplace(makeEntryName(it->path().filename()));
+    }
+    if (!listing->is_dir) {
+        ++fs_call_count_;
+        listing->is_dir = std::filesystem::is_directory(dir, ec);
+    }
+
+    std::unique_lock lock(mutex_);
+    return listings_.insert_or_assign(std::move(key), std::move(listing)).first->second;
+}
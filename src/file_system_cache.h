@@ -0,0 +1,47 @@
+#pragma once
+
+#include <atomic>
+#include <filesystem>
+#include <memory>
+#include <shared_mutex>
+#include <string>
+#include <unordered_map>
+#include <unordered_set>
+
+// Answers file existence queries from directory listings: each directory is listed once, then all the queries for its
+// entries, including the failed ones, are answered from memory. After `recheck()` each listing is checked against the
+// modification time of its directory on the next use, and is listed again if the directory has changed.
+class FileSystemCache {
+ public:
+    FileSystemCache() : current_path_(std::filesystem::current_path()) {}
+
+    const std::filesystem::path& getCurrentPath() const { return current_path_; }
+    std::filesystem::path makeAbsolute(const std::filesystem::path& path) const {
+        return (current_path_ / path).lexically_normal();
+    }
+
+    bool exists(const std::filesystem::path& abs_path);
+    void recheck() { ++generation_; }
+
+    std::size_t getProbeCount() const { return probe_count_; }
+    std::size_t getListingCount() const { return listing_count_; }
+    std::size_t getFileSystemCallCount() const { return fs_call_count_; }  // stats and directory walks actually made
+
+ private:
+    struct Listing {
+        bool is_dir = false;
+        std::filesystem::file_time_type dir_time;
+        mutable std::atomic<unsigned> generation{0};  // of the last check
+        std::unordered_set<std::string> names;
+    };
+
+    std::filesystem::path current_path_;
+    std::shared_mutex mutex_;
+    std::unordered_map<std::string, std::shared_ptr<const Listing>> listings_;
+    std::atomic<unsigned> generation_{0};
+    std::atomic<std::size_t> probe_count_{0};
+    std::atomic<std::size_t> listing_count_{0};
+    std::atomic<std::size_t> fs_call_count_{0};
+
+    std::shared_ptr<const Listing> getListing(const std::filesystem::path& dir);
+};
@@ -1,69 +1,186 @@
 #include "formatters.h"
 
+#include "file_system_cache.h"
+#include "include_cache.h"
 #include "print.h"
 
 #include <uxs/string_alg.h>
 
-std::string processText(std::string file_name, std::span<const char> text, FormattingContext& ctx, const TokenFunc& fn,
-                        TextProcFlags flags) {
-    Parser parser(std::move(file_name), text, flags);
-    Parser::Token token;
-    std::string output;
+#include <array>
+#include <utility>
+
+namespace {
+
+// Enabled fixes of a `formatText` instantiation
+constexpr unsigned kFixFileEnding = 1;
+constexpr unsigned kFixSingleStatement = 2;
+constexpr unsigned kFixPragmaOnce = 4;
+constexpr unsigned kRemoveAlreadyIncluded = 8;
+constexpr unsigned kTraceTokens = 16;
+constexpr unsigned kCheckOnly = 32;
+constexpr unsigned kFixCombinationCount = 64;
+
+// Returns the path of the file included by `token` if it is an active include directive
+std::filesystem::path findIncludedFile(Parser& parser, const Parser::Token& token, unsigned skip_level,
+                                       const FormattingParameters& params, FormattingContext& ctx) {
+    if (skip_level || !token.isPreprocIdentifier("include")) { return {}; }
+    auto next = parser.peek();
+    if (next.type != Parser::TokenType::kPreprocBody) { return {}; }
+    auto [file_name, brackets] = extractIncludePath(next.getTrimmedText());
+    return findIncludePath(file_name, brackets, params, ctx).first;
+}
 
-    bool already_matched = false;
-    unsigned skip_level = 0;
+template<unsigned Fixes>
+void formatToken(Parser& parser, const Parser::Token& token, unsigned skip_level, const FormattingParameters& params,
+                 FormattingContext& ctx, TextOutput& output) {
+    if constexpr ((Fixes & kTraceTokens) != 0) {
+        static constexpr std::array<std::string_view, 9> type_names = {
+            "kEof", "kSymbol", "kIdentifier", "kString", "kInteger", "kReal", "kPreprocId", "kPreprocBody", "kComment"};
+        if (!skip_level) {
+            printDebug(2, "token: {}, ws_count = {}: {:?}", type_names[static_cast<unsigned>(token.type)],
+                       token.getWsCount(), token.getTrimmedText());
+        }
+    }
 
-    output.reserve(text.size() + text.size() / 10);
+    if (!token.isInFixRange()) {  // copied as is, but included files are still tracked
+        if (auto file_path = findIncludedFile(parser, token, skip_level, params, ctx); !file_path.empty()) {
+            ctx.included_files.emplace_back(std::move(file_path), parser.getLine(parser.getOffset(token)));
+        }
+        output.append(token.getText());
+        return;
+    }
 
-    do {
-        token = parser.parseNext();
-        if (!parser.getFileName().empty() && token.line == 1 && token.pos == 1) { token.trimEmptyLines(); }
-        if (fn(parser, token, skip_level, output)) { return output; }
-        if (token.type == Parser::TokenType::kPreprocId) {
-            auto id = token.getPreprocIdentifier();
-
-            token = parser.parseNext();
-            if (token.type != Parser::TokenType::kPreprocBody || id != "define") { parser.revert(token); }
-
-            if (id == "define") {
-                if (token.type == Parser::TokenType::kPreprocBody) {
-                    if (!skip_level) { ctx.definitions.emplace_back(token.getFirstIdentifier()); }
-                    output.append(processText(
-                        "", token.text, ctx,
-                        [skip_level, &fn](Parser& parser, const Parser::Token& token, unsigned, std::string& output) {
-                            return fn(parser, token, skip_level, output);
-                        },
-                        TextProcFlags::kNone));
-                }
-            } else if (id == "if" || id == "ifdef" || id == "ifndef") {
-                if (!skip_level) {
-                    bool matched = token.type == Parser::TokenType::kPreprocBody &&
-                                   uxs::contains(ctx.definitions, token.getTrimmedText());
-                    if (id == "ifndef" ? matched : !matched) { ++skip_level; }
-                    already_matched = false;
-                } else {
-                    ++skip_level;
-                }
-            } else if (id == "elif") {
-                if (!skip_level) {
-                    ++skip_level, already_matched = true;
-                } else if (skip_level == 1 && !already_matched && token.type == Parser::TokenType::kPreprocBody &&
-                           uxs::contains(ctx.definitions, token.getTrimmedText())) {
-                    skip_level = 0;
-                }
-            } else if (id == "else") {
-                if (!skip_level) {
-                    ++skip_level, already_matched = true;
-                } else if (skip_level == 1 && !already_matched) {
-                    skip_level = 0;
-                }
-            } else if (id == "endif") {
-                if (skip_level) { --skip_level; }
+    if constexpr ((Fixes & kFixFileEnding) != 0) {
+        if (token.isEof()) { return; }
+    }
+
+    if constexpr ((Fixes & kFixPragmaOnce) != 0) {
+        if (fixPragmaOnce(parser, token, output)) { return; }
+    }
+    if constexpr ((Fixes & kFixSingleStatement) != 0) {
+        if (fixSingleStatement(parser, token, output)) { return; }
+    }
+
+    if (auto file_path = findIncludedFile(parser, token, skip_level, params, ctx); !file_path.empty()) {
+        if constexpr ((Fixes & kRemoveAlreadyIncluded) != 0) {
+            if (uxs::find_if(ctx.included_files, uxs::is_equal_to(file_path)).second ||
+                uxs::find(ctx.indirectly_included_files, file_path).second) {
+                parser.advance();
+                skipLine(parser, token, output);
+                return;
             }
         }
-    } while (!token.isEof());
+        ctx.included_files.emplace_back(std::move(file_path), parser.getLine(parser.getOffset(token)));
+    }
+
+    output.append(token.getText());
+}
+
+template<unsigned Fixes>
+void formatText(std::string_view file_name, TokenBuffer& tokens, TextProcFlags flags,
+                const FormattingParameters& params, FormattingContext& ctx, TextOutput& output) {
+    auto fn = [&params, &ctx](Parser& parser, const Parser::Token& token, unsigned skip_level, TextOutput& output) {
+        formatToken<Fixes>(parser, token, skip_level, params, ctx, output);
+        return (Fixes & kCheckOnly) != 0 && output.isChanged();  // stop at the first change
+    };
+    processText(file_name, tokens, ctx, fn, output, flags);
+}
+
+using FormatTextFunc = void (*)(std::string_view, TokenBuffer&, TextProcFlags, const FormattingParameters&,
+                                FormattingContext&, TextOutput&);
+
+template<std::size_t... Fixes>
+constexpr std::array<FormatTextFunc, sizeof...(Fixes)> makeFormatTextTable(std::index_sequence<Fixes...>) {
+    return {&formatText<Fixes>...};
+}
+
+// Outputs tokens up to and including token `last_index`, or up to the end of file
+void outputUpTo(Parser& parser, std::size_t last_index, TextOutput& output) {
+    while (!parser.peek().isEof() && parser.getIndex() <= last_index) { output.append(parser.parseNext().getText()); }
+}
+
+// Outputs tokens up to and including the semicolon which is not enclosed in brackets `ch_open` and `ch_close`, or up
+// to the end of file; unpaired brackets are level-tracked from `level` to stay compatible with unbalanced preprocessor
+// branches. Returns `false` if the end of file is reached before the semicolon
+bool outputUpToSemicolon(Parser& parser, char ch_open, char ch_close, TextOutput& output, int level = 0) {
+    while (!parser.peek().isEof()) {
+        std::size_t close_index = level == 0 && parser.peek().isSymbol(ch_open) ? parser.findMatch(parser.getIndex()) :
+                                                                                  TokenBuffer::kNoMatch;
+        if (close_index != TokenBuffer::kNoMatch) {
+            outputUpTo(parser, close_index, output);
+            continue;
+        }
+        auto token = parser.parseNext();
+        output.append(token.getText());
+        if (level == 0 && token.isSymbol(';')) { return true; }
+        if (token.isSymbol(ch_open)) {
+            ++level;
+        } else if (token.isSymbol(ch_close)) {
+            --level;
+        }
+    }
+    return false;
+}
+
+}  // namespace
+
+bool FormattingContext::isDefined(std::string_view id) {
+    bool is_defined = definitions.contains(id);
+    if (scan_result) {
+        scan_result->events.emplace_back(
+            HeaderScanResult::Event{HeaderScanResult::EventType::kCondition, is_defined, 0, std::string(id)});
+    }
+    return is_defined;
+}
+
+void FormattingContext::addDefinition(std::string_view id) {
+    definitions.add(id);
+    if (scan_result) {
+        scan_result->events.emplace_back(
+            HeaderScanResult::Event{HeaderScanResult::EventType::kDefinition, false, 0, std::string(id)});
+    }
+}
 
-    return output;
+bool FormattingContext::addOnceIncluded(const std::filesystem::path& file_path) {
+    auto [it, success] = once_included_files.emplace(file_path);
+    if (success) { once_included_log.emplace_back(it); }
+    return success;
+}
+
+void formatText(std::string_view file_name, TokenBuffer& tokens, const FormattingParameters& params,
+                FormattingContext& ctx, TextOutput& output) {
+    static constexpr auto format_text_table = makeFormatTextTable(std::make_index_sequence<kFixCombinationCount>{});
+    unsigned fixes = (params.fix_file_ending ? kFixFileEnding : 0) |
+                     (params.fix_single_statement ? kFixSingleStatement : 0) |
+                     (params.fix_pragma_once ? kFixPragmaOnce : 0) |
+                     (params.remove_already_included ? kRemoveAlreadyIncluded : 0) |
+                     (g_debug_level >= 2 ? kTraceTokens : 0) | (params.check_only ? kCheckOnly : 0);
+    TextProcFlags flags = params.fix_id_naming ? TextProcFlags::kFixIdNaming : TextProcFlags::kNone;
+    format_text_table[fixes](file_name, tokens, flags, params, ctx, output);
+}
+
+std::pair<std::filesystem::path, IncludePathType> findIncludePath(const std::filesystem::path& path,
+                                                                  IncludeBrackets brackets,
+                                                                  const FormattingParameters& params,
+                                                                  const FormattingContext& ctx) {
+    if (path.empty()) { return {}; }
+    auto& fs_cache = *ctx.file_system_cache;
+    if (path.is_absolute()) {
+        auto path_norm = path.lexically_normal();
+        if (fs_cache.exists(path_norm)) { return std::make_pair(std::move(path_norm), IncludePathType::kCustom); }
+        return {};
+    }
+    if (brackets == IncludeBrackets::kDoubleQuotes) {
+        for (const auto& dir : uxs::make_reverse_range(ctx.path_stack)) {
+            auto path_cat = fs_cache.makeAbsolute(dir.parent_path() / path);
+            if (fs_cache.exists(path_cat)) { return std::make_pair(std::move(path_cat), IncludePathType::kCustom); }
+        }
+    }
+    for (const auto& [dir, dir_type] : params.include_dirs) {
+        auto path_cat = fs_cache.makeAbsolute(dir / path);
+        if (fs_cache.exists(path_cat)) { return std::make_pair(std::move(path_cat), dir_type); }
+    }
+    return {};
 }
 
 std::pair<std::string, IncludeBrackets> extractIncludePath(std::string_view text) {
@@ -90,83 +207,29 @@ std::pair<std::string, IncludeBrackets> extractIncludePath(std::string_view text
     return std::make_pair(uxs::decode_escapes(text, "\a\b\f\n\r\t\v\\\"", "abfnrtv\\\""), brackets);
 }
 
-void skipLine(Parser& parser, const Parser::Token& first_tkn, std::string& output) {
+void skipLine(Parser& parser, const Parser::Token& first_tkn, TextOutput& output) {
     if (first_tkn.isFirst()) {
-        auto next = parser.parseNext();
+        auto& next = parser.peek();
         next.trimEmptyLines();
-        next.line = 1, next.pos = 1;
-        parser.revert(next);
+        next.flags |= Parser::Token::kFirst;
     } else {
         output.append(first_tkn.getEmptyLines());
     }
 }
 
-void fixIdNaming(Parser& parser, const Parser::Token& token, const FormattingParameters& /*params*/,
-                 std::string& output) {
-    if (token.type != Parser::TokenType::kIdentifier) {
-        output.append(token.text);
-        return;
-    }
-
-    auto id = token.getTrimmedText();
-    std::string new_id{id};
-
-    auto next = parser.parseNext();
-    if (!next.isSymbol('(')) {
-        if (id.size() > 1 &&
-            (id[0] == '_' ||
-             (!uxs::is_upper(id[0]) && !(id[0] == 'k' && uxs::is_upper(id[1])) /* Probably enum member */ &&
-              !uxs::all_of(
-                  id, [](char ch) { return ch == '_' || uxs::is_digit(ch) || uxs::is_lower(ch); }) /* No upper case */
-              && !uxs::all_of(id, [](char ch) {
-                     return ch == '_' || uxs::is_digit(ch) || uxs::is_upper(ch);
-                 }) /* No lower case */))) {
-            new_id.clear();
-            bool is_member = false;
-            if (id[0] == '_') {
-                is_member = true;
-                id = id.substr(1);
-            }
-            new_id.push_back(id[0]);
-            for (auto it = id.begin() + 1; it != id.end(); ++it) {
-                if ((uxs::is_digit(*it) || uxs::is_upper(*it)) && uxs::is_lower(*(it - 1))) { new_id.push_back('_'); }
-                new_id.push_back(uxs::to_lower(*it));
-            }
-            if (is_member) { new_id.push_back('_'); }
-        }
-    } else {  // is a function
-        if (id[0] == '_') {
-            printWarning("{}:{}: underscored function name {}", parser.getFileName(), parser.getLn(), id);
-        }
-    }
-
-    parser.revert(next);
-
-    output.append(token.text.substr(0, token.ws_count));
-    output.append(new_id);
-}
-
-bool fixPragmaOnce(Parser& parser, const Parser::Token& first_tkn, std::string& output) {
+bool fixPragmaOnce(Parser& parser, const Parser::Token& first_tkn, TextOutput& output) {
     std::string_view ext{parser.getFileName()};
     auto dot_pos = ext.rfind('.');
     ext = dot_pos != std::string::npos ? ext.substr(dot_pos + 1) : std::string_view{};
     bool is_header = ext.starts_with('h');
 
-    auto next = parser.parseNext();
+    auto next = parser.peek();
 
     if (is_header && first_tkn.isFirstSignificant() && first_tkn.isPreprocIdentifier("ifndef") &&
         next.type == Parser::TokenType::kPreprocBody) {
-        auto defined = next.getFirstIdentifier();
-
-        auto next2 = parser.parseNext();
-        auto next3 = parser.parseNext();
-        parser.revert(next3);
-        parser.revert(next2);
-
-        if (next2.isPreprocIdentifier("define") && next3.isPreprocBodyFirstId(defined)) {
-            // C-style header protection
-            parser.revert(next);
-            return false;
+        if (parser.peek(1).isPreprocIdentifier("define") &&
+            parser.peek(2).isPreprocBodyFirstId(next.getFirstIdentifier())) {
+            return false;  // C-style header protection
         }
     }
 
@@ -176,118 +239,103 @@ bool fixPragmaOnce(Parser& parser, const Parser::Token& first_tkn, std::string&
     }
 
     if (first_tkn.isPreprocIdentifier("pragma") && next.isPreprocBodyFirstId("once")) {
+        parser.advance();
         skipLine(parser, first_tkn, output);
         return true;
     }
 
-    parser.revert(next);
     return false;
 }
 
-bool fixSingleStatement(Parser& parser, const Parser::Token& first_tkn, std::string& output) {
+bool fixSingleStatement(Parser& parser, const Parser::Token& first_tkn, TextOutput& output) {
     static constexpr std::array<std::string_view, 4> key_words = {"if", "while", "for", "do"};
-    if (!first_tkn.isAnyOfIdentifiers(key_words)) { return false; }
+    if (!first_tkn.isAnyOfIdentifiers(key_words) || !first_tkn.isInFixRange()) { return false; }
 
-    output.append(first_tkn.text);
+    output.append(first_tkn.getText());
 
-    Parser::Token token;
     bool is_else_block = false;
 
+    // Tokens are consumed only when they are output or replaced; the end of file is consumed, so its whitespace is
+    // dropped, if it ends the condition or an unterminated statement
     do {
-        token = parser.parseNext();
         if (!is_else_block && !first_tkn.isIdentifier("do")) {
-            for (int level = -1; level != 0 && !token.isEof(); token = parser.parseNext()) {
-                output.append(token.text);
-                if (level >= 0) {
-                    level = token.trackLevel(level, '(', ')');
-                } else if (token.isSymbol('(')) {
-                    level = 1;
-                }
+            while (!parser.peek().isEof() && !parser.peek().isSymbol('(')) {
+                output.append(parser.parseNext().getText());
             }
+            if (!parser.peek().isEof()) { outputUpTo(parser, parser.findMatch(parser.getIndex()), output); }
         }
 
-        std::vector<Parser::Token> comments;
-        comments.reserve(16);
-        while (token.isComment()) {
-            comments.emplace_back(token);
-            token = parser.parseNext();
-        }
+        std::size_t comment_count = 0;
+        while (parser.peek(comment_count).isComment()) { ++comment_count; }
 
-        if (!token.isEof()) { output.append(" {"); }
-        for (const auto& comment : comments) { output.append(comment.text); }
-        comments.clear();
-        if (token.isEof()) { return true; }
+        bool is_eof = parser.peek(comment_count).isEof();
+        if (!is_eof) { output.append(" {"); }
+        for (; comment_count != 0; --comment_count) { output.append(parser.parseNext().getText()); }
+        if (is_eof) {
+            parser.advance();
+            return true;
+        }
 
-        if (!token.isSymbol('{')) {
+        if (!parser.peek().isSymbol('{')) {
+            auto token = parser.parseNext();
             bool make_nl = token.hasNewLine(), has_comments = false;
             if (!fixSingleStatement(parser, token, output)) {
-                for (int level = 0; !token.isEof(); token = parser.parseNext()) {
-                    output.append(token.text);
-                    if (level == 0 && token.isSymbol(';')) { break; }
-                    level = token.trackLevel(level, '{', '}');
+                output.append(token.getText());
+                // The first token can't be an opening brace, but an unpaired closing one is counted
+                if (!token.isSymbol(';') &&
+                    !outputUpToSemicolon(parser, '{', '}', output, token.isSymbol('}') ? -1 : 0)) {
+                    parser.advance();
                 }
             }
 
-            token = parser.parseNext();
-            while (token.isComment() && !token.hasNewLine()) {
+            while (parser.peek().isComment() && !parser.peek().hasNewLine()) {
                 has_comments = true;
-                output.append(token.text);
-                token = parser.parseNext();
+                output.append(parser.parseNext().getText());
             }
 
-            output.append(make_nl || has_comments ? first_tkn.makeIndented("}") : " }");
+            output.append(make_nl || has_comments ? parser.makeIndented(first_tkn, "}") : " }");
         } else {
-            token = parser.parseNext();
-            for (int level = 1; level != 0 && !token.isEof(); token = parser.parseNext()) {
+            std::size_t close_index = parser.findMatch(parser.getIndex());
+            parser.advance();  // replaced with ` {` before comments
+            while (!parser.peek().isEof()) {
+                // If a nested fix has run past the matching brace, the next unconsumed brace closes the block
+                std::size_t index = parser.getIndex();
+                bool is_close = index == close_index || (index > close_index && parser.peek().isSymbol('}'));
+                auto token = parser.parseNext();
                 if (!fixSingleStatement(parser, token, output)) {
-                    output.append(token.text);
-                    level = token.trackLevel(level, '{', '}');
+                    output.append(token.getText());
+                    if (is_close) { break; }
                 }
             }
         }
 
         bool has_comments = false;
-        while (token.isComment()) {
+        while (parser.peek().isComment()) {
             has_comments = true;
-            output.append(token.text);
-            token = parser.parseNext();
+            output.append(parser.parseNext().getText());
         }
 
         if (first_tkn.isIdentifier("do")) {
-            if (token.isIdentifier("while")) {
-                output.append(has_comments ? first_tkn.makeIndented("while") : " while");
-                token = parser.parseNext();
-            }
-            for (int level = 0; !token.isEof(); token = parser.parseNext()) {
-                output.append(token.text);
-                if (level == 0 && token.isSymbol(';')) { break; }
-                level = token.trackLevel(level, '(', ')');
+            if (parser.peek().isIdentifier("while")) {
+                output.append(has_comments ? parser.makeIndented(first_tkn, "while") : " while");
+                parser.advance();
             }
-            break;
-        } else if (!is_else_block && first_tkn.isIdentifier("if")) {
-            if (token.isIdentifier("else")) {
-                output.append(has_comments ? first_tkn.makeIndented("else") : " else");
-                token = parser.parseNext();
-                while (token.isComment()) {
-                    comments.emplace_back(token);
-                    token = parser.parseNext();
-                }
-                if (token.isIdentifier("if")) {
-                    for (const auto& comment : comments) { output.append(comment.text); }
-                    output.append(!comments.empty() ? first_tkn.makeIndented("if") : " if");
-                } else {
-                    parser.revert(token);
-                    while (!comments.empty()) {
-                        parser.revert(comments.back());
-                        comments.pop_back();
-                    }
-                    is_else_block = true;
-                }
-                comments.clear();
-                continue;  // next 'else if'/'else' block
+            if (!outputUpToSemicolon(parser, '(', ')', output)) { parser.advance(); }
+        } else if (!is_else_block && first_tkn.isIdentifier("if") && parser.peek().isIdentifier("else")) {
+            output.append(has_comments ? parser.makeIndented(first_tkn, "else") : " else");
+            parser.advance();
+            comment_count = 0;
+            while (parser.peek(comment_count).isComment()) { ++comment_count; }
+            if (parser.peek(comment_count).isIdentifier("if")) {
+                bool has_comments_before_if = comment_count != 0;
+                for (; comment_count != 0; --comment_count) { output.append(parser.parseNext().getText()); }
+                output.append(has_comments_before_if ? parser.makeIndented(first_tkn, "if") : " if");
+                parser.advance();
+            } else {
+                is_else_block = true;
             }
+            continue;  // next 'else if'/'else' block
         }
-        parser.revert(token);
         break;
     } while (true);
 
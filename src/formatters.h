@@ -1,6 +1,8 @@
 #pragma once
 
+#include "definition_table.h"
 #include "parser.h"
+#include "text_output.h"
 
 #include <filesystem>
 #include <set>
@@ -14,26 +16,99 @@ struct FormattingParameters {
     bool fix_id_naming = false;
     bool fix_pragma_once = false;
     bool remove_already_included = false;
+    bool check_only = false;
+    unsigned lex_thread_count = 1;  // for a file which is large enough to be lexed in parallel
     std::vector<std::string> definitions;
     std::vector<std::pair<std::filesystem::path, IncludePathType>> include_dirs;
 };
 
+struct HeaderScanResult;
+class IncludeScanCache;
+class FileSystemCache;
+
 struct FormattingContext {
-    std::vector<std::string> definitions;
+    DefinitionTable definitions;
     std::vector<std::filesystem::path> path_stack;
     std::set<std::filesystem::path> once_included_files;
+    std::vector<std::set<std::filesystem::path>::iterator> once_included_log;
     std::vector<std::pair<std::filesystem::path, int>> included_files;
     std::set<std::filesystem::path> indirectly_included_files;
+    FileSystemCache* file_system_cache = nullptr;
+    IncludeScanCache* include_scan_cache = nullptr;
+    std::string include_config_key;
+    HeaderScanResult* scan_result = nullptr;
+    std::set<std::filesystem::path>* scanned_files = nullptr;  // collects custom headers read by the scan if given
+
+    bool isDefined(std::string_view id);
+    void addDefinition(std::string_view id);
+    bool addOnceIncluded(const std::filesystem::path& file_path);
 };
 
-using TokenFunc = std::function<bool(Parser&, const Parser::Token&, unsigned, std::string&)>;
+// Calls `fn(parser, token, skip_level, output)` for each token, tracking definitions and conditional sections;
+// stops if `fn` returns `true`
+template<typename TokenFn>
+void processText(std::string_view file_name, TokenBuffer& tokens, FormattingContext& ctx, const TokenFn& fn,
+                 TextOutput& output, TextProcFlags flags = TextProcFlags::kNone, unsigned skip_level = 0) {
+    Parser parser(file_name, tokens, flags);
+    Parser::Token token;
+
+    bool already_matched = false;
+
+    do {
+        token = parser.parseNext();
+        if (!parser.getFileName().empty() && token.isFirst()) { token.trimEmptyLines(); }
+        if (fn(parser, token, skip_level, output)) { return; }
+        if (token.type == Parser::TokenType::kPreprocId) {
+            auto id = token.getPreprocIdentifier();
+
+            token = parser.peek();
+
+            if (id == "define") {
+                if (token.type == Parser::TokenType::kPreprocBody) {
+                    auto& body_tokens = parser.getBodyTokens();
+                    parser.advance();
+                    if (!skip_level) { ctx.addDefinition(token.getFirstIdentifier()); }
+                    processText("", body_tokens, ctx, fn, output, TextProcFlags::kNone, skip_level);
+                }
+            } else if (id == "if" || id == "ifdef" || id == "ifndef") {
+                if (!skip_level) {
+                    bool matched = token.type == Parser::TokenType::kPreprocBody &&
+                                   ctx.isDefined(token.getTrimmedText());
+                    if (id == "ifndef" ? matched : !matched) { ++skip_level; }
+                    already_matched = false;
+                } else {
+                    ++skip_level;
+                }
+            } else if (id == "elif") {
+                if (!skip_level) {
+                    ++skip_level, already_matched = true;
+                } else if (skip_level == 1 && !already_matched && token.type == Parser::TokenType::kPreprocBody &&
+                           ctx.isDefined(token.getTrimmedText())) {
+                    skip_level = 0;
+                }
+            } else if (id == "else") {
+                if (!skip_level) {
+                    ++skip_level, already_matched = true;
+                } else if (skip_level == 1 && !already_matched) {
+                    skip_level = 0;
+                }
+            } else if (id == "endif") {
+                if (skip_level) { --skip_level; }
+            }
+        }
+    } while (!token.isEof());
+}
 
-std::string processText(std::string file_name, std::span<const char> text, FormattingContext& ctx,
-                        const TokenFunc& fn_token, TextProcFlags flags = TextProcFlags::kAtBegOfLine);
+// Applies enabled fixes of `params` to the tokens of a source file
+void formatText(std::string_view file_name, TokenBuffer& tokens, const FormattingParameters& params,
+                FormattingContext& ctx, TextOutput& output);
 
+std::pair<std::filesystem::path, IncludePathType> findIncludePath(const std::filesystem::path& path,
+                                                                  IncludeBrackets brackets,
+                                                                  const FormattingParameters& params,
+                                                                  const FormattingContext& ctx);
 std::pair<std::string, IncludeBrackets> extractIncludePath(std::string_view text);
 
-void skipLine(Parser& parser, const Parser::Token& first_tkn, std::string& output);
-void fixIdNaming(Parser& parser, const Parser::Token& token, const FormattingParameters& params, std::string& output);
-bool fixPragmaOnce(Parser& parser, const Parser::Token& first_tkn, std::string& output);
-bool fixSingleStatement(Parser& parser, const Parser::Token& first_tkn, std::string& output);
+void skipLine(Parser& parser, const Parser::Token& first_tkn, TextOutput& output);
+bool fixPragmaOnce(Parser& parser, const Parser::Token& first_tkn, TextOutput& output);
+bool fixSingleStatement(Parser& parser, const Parser::Token& first_tkn, TextOutput& output);
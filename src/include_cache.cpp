@@ -0,0 +1,254 @@
+#include "include_cache.h"
+
+#include "mapped_file.h"
+#include "print.h"
+
+#include <uxs/io/filebuf.h>
+
+#include <random>
+#include <thread>
+#include <utility>
+
+namespace {
+
+constexpr std::uint32_t kCacheFileMagic = 0x43534643;  // "CFSC"
+constexpr std::uint8_t kCacheFileVersion = 1;
+
+std::uint64_t calcHash(std::span<const char> data) {
+    std::uint64_t hash = 14695981039346656037ull;  // FNV-1a
+    for (char ch : data) { hash = (hash ^ static_cast<unsigned char>(ch)) * 1099511628211ull; }
+    return hash;
+}
+
+void writeUInt(std::string& out, std::uint64_t v, unsigned byte_count) {
+    for (unsigned n = 0; n != byte_count; ++n, v >>= 8) { out.push_back(static_cast<char>(v & 0xff)); }
+}
+
+void writeVarUInt(std::string& out, std::uint64_t v) {
+    for (; v >= 0x80; v >>= 7) { out.push_back(static_cast<char>(0x80 | (v & 0x7f))); }
+    out.push_back(static_cast<char>(v));
+}
+
+void writeString(std::string& out, std::string_view s) {
+    writeVarUInt(out, s.size());
+    out.append(s);
+}
+
+class BinaryReader {
+ public:
+    explicit BinaryReader(std::string_view data) : data_(data) {}
+    bool isOk() const { return ok_; }
+    bool isEnd() const { return data_.empty(); }
+
+    std::uint64_t readUInt(unsigned byte_count) {
+        if (data_.size() < byte_count) { return fail(); }
+        std::uint64_t v = 0;
+        for (unsigned n = 0; n != byte_count; ++n) { v |= std::uint64_t(static_cast<unsigned char>(data_[n])) << 8 * n; }
+        data_ = data_.substr(byte_count);
+        return v;
+    }
+
+    std::uint64_t readVarUInt() {
+        std::uint64_t v = 0;
+        for (unsigned shift = 0; shift < 64; shift += 7) {
+            if (data_.empty()) { return fail(); }
+            auto byte = static_cast<unsigned char>(data_.front());
+            data_ = data_.substr(1);
+            v |= std::uint64_t(byte & 0x7f) << shift;
+            if (!(byte & 0x80)) { return v; }
+        }
+        return fail();
+    }
+
+    std::size_t readCount() {  // the count of items, each taking at least one byte
+        std::uint64_t count = readVarUInt();
+        if (count > data_.size()) { return fail(); }
+        return static_cast<std::size_t>(count);
+    }
+
+    std::string_view readString() {
+        std::uint64_t sz = readVarUInt();
+        if (!ok_ || data_.size() < sz) { return fail(), std::string_view{}; }
+        auto s = data_.substr(0, sz);
+        data_ = data_.substr(sz);
+        return s;
+    }
+
+ private:
+    std::string_view data_;
+    bool ok_ = true;
+
+    std::uint64_t fail() {
+        ok_ = false, data_ = {};
+        return 0;
+    }
+};
+
+}  // namespace
+
+std::string IncludeScanCache::makeIncludeConfigKey(const FormattingParameters& params) {
+    std::string key;
+    for (const auto& [dir, dir_type] : params.include_dirs) {
+        key += dir_type == IncludePathType::kSystem ? 'S' : 'C';
+        key += dir.generic_string();
+        key.push_back('\0');
+    }
+    return key;
+}
+
+bool IncludeScanCache::getFileInfo(const std::filesystem::path& file_path, FileInfo& info) {
+    std::error_code ec;
+    auto time = std::filesystem::last_write_time(file_path, ec);
+    if (ec) { return false; }
+    info.size = std::filesystem::file_size(file_path, ec);
+    if (ec) { return false; }
+    info.time = static_cast<std::int64_t>(time.time_since_epoch().count());
+    return true;
+}
+
+std::string IncludeScanCache::makeKey(std::string_view include_config_key, const std::filesystem::path& file_path) {
+    std::string key(include_config_key);
+    key.push_back('\0');
+    return key += file_path.generic_string();
+}
+
+std::vector<std::shared_ptr<const HeaderScanResult>> IncludeScanCache::find(const std::string& key,
+                                                                            const std::filesystem::path& file_path) {
+    const unsigned generation = generation_;
+    {
+        std::lock_guard lock(mutex_);
+        auto it = entries_.find(key);
+        if (it != entries_.end()) {
+            auto& entry = it->second;
+            FileInfo info;
+            if (std::exchange(entry.generation, generation) == generation ||
+                (getFileInfo(file_path, info) && info.time == entry.file_time && info.size == entry.file_size)) {
+                return entry.variants;
+            }
+            entries_.erase(it);  // the header has changed
+        }
+    }
+
+    Entry entry;
+    if (cache_dir_.empty() || !loadEntry(key, file_path, entry)) { return {}; }
+
+    ++load_count_;
+    entry.generation = generation;
+    std::lock_guard lock(mutex_);
+    return entries_.emplace(key, std::move(entry)).first->second.variants;
+}
+
+void IncludeScanCache::add(const std::string& key, const FileInfo* file_info, std::span<const char> text,
+                           std::shared_ptr<const HeaderScanResult> result) {
+    Entry entry;
+    if (file_info) { entry.file_time = file_info->time, entry.file_size = file_info->size; }
+    entry.content_hash = calcHash(text);
+    entry.generation = generation_;
+
+    {
+        std::lock_guard lock(mutex_);
+        auto [it, success] = entries_.emplace(key, entry);
+        if (!success && (it->second.content_hash != entry.content_hash || it->second.file_size != entry.file_size)) {
+            it->second = entry;  // the header has changed
+        }
+        auto& variants = it->second.variants;
+        // The most recent variant is tried first
+        if (variants.size() == kMaxVariantCount) { variants.pop_back(); }
+        variants.emplace(variants.begin(), std::move(result));
+        if (cache_dir_.empty() || !file_info) { return; }
+        entry = it->second;
+    }
+
+    storeEntry(key, entry);
+}
+
+void IncludeScanCache::invalidate(const std::filesystem::path& file_path) {
+    // The path is the last part of a key, it follows the zero terminating the include configuration
+    const auto path = file_path.generic_string();
+    std::lock_guard lock(mutex_);
+    std::erase_if(entries_, [&path](const auto& item) {
+        const std::string_view key = item.first;
+        return key.size() > path.size() && key.ends_with(path) && key[key.size() - path.size() - 1] == '\0';
+    });
+}
+
+std::filesystem::path IncludeScanCache::getCacheFilePath(const std::string& key) const {
+    auto name = uxs::format("{:016x}", calcHash(key));
+    return cache_dir_ / name.substr(0, 2) / name.substr(2);
+}
+
+bool IncludeScanCache::loadEntry(const std::string& key, const std::filesystem::path& file_path, Entry& entry) const {
+    MappedFile cache_file;
+    if (!cache_file.open(getCacheFilePath(key))) { return false; }
+
+    BinaryReader reader(std::string_view(cache_file.getData().data(), cache_file.getData().size()));
+    if (reader.readUInt(4) != kCacheFileMagic || reader.readUInt(1) != kCacheFileVersion ||
+        reader.readString() != key) {
+        return false;
+    }
+
+    entry.file_time = static_cast<std::int64_t>(reader.readUInt(8));
+    entry.file_size = reader.readUInt(8);
+    entry.content_hash = reader.readUInt(8);
+    entry.variants.resize(std::min(reader.readCount(), kMaxVariantCount));
+    for (auto& variant : entry.variants) {
+        auto result = std::make_shared<HeaderScanResult>();
+        result->events.resize(reader.readCount());
+        for (auto& event : result->events) {
+            unsigned type = static_cast<unsigned>(reader.readUInt(1));
+            if ((type & 0xf) > static_cast<unsigned>(HeaderScanResult::EventType::kInclude)) { return false; }
+            event.type = static_cast<HeaderScanResult::EventType>(type & 0xf);
+            event.flag = (type & 0x10) != 0;
+            event.line = static_cast<unsigned>(reader.readVarUInt());
+            event.text = reader.readString();
+        }
+        if (!reader.isOk()) { return false; }
+        variant = std::move(result);
+    }
+    if (!reader.isOk() || !reader.isEnd()) { return false; }
+
+    // Validate against the header: same time and size, or same size and contents
+    FileInfo info;
+    if (!getFileInfo(file_path, info) || info.size != entry.file_size) { return false; }
+    if (info.time != entry.file_time) {
+        MappedFile file;
+        if (!file.open(file_path) || calcHash(file.getData()) != entry.content_hash) { return false; }
+        entry.file_time = info.time;
+    }
+    return true;
+}
+
+void IncludeScanCache::storeEntry(const std::string& key, const Entry& entry) const {
+    std::string data;
+    writeUInt(data, kCacheFileMagic, 4);
+    writeUInt(data, kCacheFileVersion, 1);
+    writeString(data, key);
+    writeUInt(data, static_cast<std::uint64_t>(entry.file_time), 8);
+    writeUInt(data, entry.file_size, 8);
+    writeUInt(data, entry.content_hash, 8);
+    writeVarUInt(data, entry.variants.size());
+    for (const auto& variant : entry.variants) {
+        writeVarUInt(data, variant->events.size());
+        for (const auto& event : variant->events) {
+            writeUInt(data, static_cast<unsigned>(event.type) | (event.flag ? 0x10 : 0), 1);
+            writeVarUInt(data, event.line);
+            writeString(data, event.text);
+        }
+    }
+
+    // Write to a unique temporary file and rename it, so concurrent readers never see a partially written file
+    auto file_path = getCacheFilePath(key);
+    std::error_code ec;
+    std::filesystem::create_directories(file_path.parent_path(), ec);
+    auto tmp_file_path = file_path;
+    tmp_file_path += uxs::format(".{:x}.{:x}.tmp", std::hash<std::thread::id>{}(std::this_thread::get_id()),
+                                 std::random_device{}());
+    if (uxs::filebuf ofile(tmp_file_path.c_str(), "w"); ofile) {
+        ofile.write(data);
+    } else {
+        printDebug(1, "could not write include scan cache file `{}`", tmp_file_path.generic_string());
+        return;
+    }
+    std::filesystem::rename(tmp_file_path, file_path, ec);
+    if (ec) { std::filesystem::remove(tmp_file_path, ec); }
+}
@@ -0,0 +1,82 @@
+#pragma once
+
+#include "formatters.h"
+
+#include <atomic>
+#include <memory>
+#include <mutex>
+#include <span>
+#include <unordered_map>
+
+// Everything a header scan depends on or affects, in order of occurrence: definitions made, outcomes of evaluated
+// preprocessor conditions, `#pragma once` and include directives of active regions. A recorded result can be
+// replayed instead of reading and lexing the header again while the replayed conditions give the same outcomes.
+struct HeaderScanResult {
+    enum class EventType : std::uint8_t { kDefinition = 0, kCondition, kPragmaOnce, kInclude };
+
+    struct Event {
+        EventType type = EventType::kDefinition;
+        bool flag = false;  // outcome for `kCondition`, angled brackets for `kInclude`
+        unsigned line = 0;
+        std::string text;
+    };
+
+    std::vector<Event> events;
+    bool is_complete = true;  // `false` if the scan was stopped by `#pragma once` of already included header
+};
+
+// Scan results are kept in memory and, if a cache directory is specified, in one file per header and include
+// configuration there. A stored file is valid while the header has the same modification time and size, or the same
+// size and content hash. Files are replaced atomically, so several processes can share a cache directory. After
+// `recheck()` each entry in memory is checked against the modification time and size of its header on the next use.
+class IncludeScanCache {
+ public:
+    // Modification time and size of a header; they must be taken before its text is read, so that a header replaced
+    // while it is scanned does not get the time and size of its new version together with results of the old one
+    struct FileInfo {
+        std::int64_t time = 0;
+        std::uint64_t size = 0;
+    };
+
+    static bool getFileInfo(const std::filesystem::path& file_path, FileInfo& info);
+    static std::string makeIncludeConfigKey(const FormattingParameters& params);
+    static std::string makeKey(std::string_view include_config_key, const std::filesystem::path& file_path);
+
+    void setCacheDir(std::filesystem::path dir) { cache_dir_ = std::move(dir); }
+    void recheck() { ++generation_; }
+    void invalidate(const std::filesystem::path& file_path);  // drops entries of a header rewritten by the run itself
+
+    std::vector<std::shared_ptr<const HeaderScanResult>> find(const std::string& key,
+                                                              const std::filesystem::path& file_path);
+    void add(const std::string& key, const FileInfo* file_info, std::span<const char> text,
+             std::shared_ptr<const HeaderScanResult> result);
+
+    void countHit() { ++hit_count_; }
+    void countMiss() { ++miss_count_; }
+    std::size_t getHitCount() const { return hit_count_; }
+    std::size_t getMissCount() const { return miss_count_; }
+    std::size_t getLoadCount() const { return load_count_; }
+
+ private:
+    static constexpr std::size_t kMaxVariantCount = 4;
+
+    struct Entry {
+        std::int64_t file_time = 0;
+        std::uint64_t file_size = 0;
+        std::uint64_t content_hash = 0;
+        unsigned generation = 0;  // of the last check
+        std::vector<std::shared_ptr<const HeaderScanResult>> variants;
+    };
+
+    std::filesystem::path cache_dir_;
+    std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::atomic<std::size_t> hit_count_{0};
+    std::atomic<std::size_t> miss_count_{0};
+    std::atomic<std::size_t> load_count_{0};
+    std::atomic<unsigned> generation_{0};
+
+    std::filesystem::path getCacheFilePath(const std::string& key) const;
+    bool loadEntry(const std::string& key, const std::filesystem::path& file_path, Entry& entry) const;
+    void storeEntry(const std::string& key, const Entry& entry) const;
+};
@@ -0,0 +1,194 @@
+#include "input_files.h"
+
+#include "print.h"
+
+#include <uxs/algorithm.h>
+
+#include <algorithm>
+#include <array>
+#include <charconv>
+#include <set>
+#include <span>
+
+namespace {
+
+bool hasWildcards(std::string_view s) { return s.find_first_of("*?") != std::string_view::npos; }
+
+// Parses a decimal number at the beginning of `s` and removes it from `s`
+bool parseNumber(std::string_view& s, unsigned& n) {
+    auto [p, ec] = std::from_chars(s.data(), s.data() + s.size(), n);
+    if (ec != std::errc{}) { return false; }
+    s.remove_prefix(static_cast<std::size_t>(p - s.data()));
+    return true;
+}
+
+// Parses `<first>[,<count>]` of a unified diff hunk header
+bool parseHunkRange(std::string_view& s, unsigned& first, unsigned& count) {
+    if (!parseNumber(s, first)) { return false; }
+    count = 1;
+    if (!s.starts_with(',')) { return true; }
+    s.remove_prefix(1);
+    return parseNumber(s, count);
+}
+
+std::string makeFileName(const std::filesystem::path& dir, const std::string& name) {
+    return dir.empty() ? name : (dir / name).generic_string();
+}
+
+std::vector<std::pair<std::string, bool>> listDirectory(const std::filesystem::path& dir) {
+    std::vector<std::pair<std::string, bool>> entries;  // (name, is directory)
+    std::error_code ec;
+    for (std::filesystem::directory_iterator it(dir.empty() ? std::filesystem::path(".") : dir, ec), end;
+         !ec && it != end; it.increment(ec)) {
+        std::string name = it->path().filename().string();
+        if (name.starts_with('.')) { continue; }
+        std::error_code ec_status;
+        if (it->is_directory(ec_status)) {
+            entries.emplace_back(std::move(name), true);
+        } else if (it->is_regular_file(ec_status)) {
+            entries.emplace_back(std::move(name), false);
+        }
+    }
+    std::sort(entries.begin(), entries.end());
+    return entries;
+}
+
+void collectDirectoryFiles(const std::filesystem::path& dir, std::vector<std::string>& files) {
+    for (const auto& [name, is_dir] : listDirectory(dir)) {
+        if (is_dir) {
+            collectDirectoryFiles(dir / name, files);
+        } else if (isSourceFileName(name)) {
+            files.emplace_back(makeFileName(dir, name));
+        }
+    }
+}
+
+void expandPattern(const std::filesystem::path& dir, std::span<const std::string> components,
+                   std::vector<std::string>& files) {
+    const auto& comp = components.front();
+    auto tail = components.subspan(1);
+    if (comp == "**") {
+        if (tail.empty()) { return collectDirectoryFiles(dir, files); }
+        expandPattern(dir, tail, files);
+        for (const auto& [name, is_dir] : listDirectory(dir)) {
+            if (is_dir) { expandPattern(dir / name, components, files); }
+        }
+    } else if (hasWildcards(comp)) {
+        for (const auto& [name, is_dir] : listDirectory(dir)) {
+            if (!matchWildcard(comp, name)) { continue; }
+            if (tail.empty()) {
+                if (!is_dir) { files.emplace_back(makeFileName(dir, name)); }
+            } else if (is_dir) {
+                expandPattern(dir / name, tail, files);
+            }
+        }
+    } else if (tail.empty()) {
+        std::error_code ec;
+        if (std::filesystem::is_regular_file(dir / comp, ec)) { files.emplace_back(makeFileName(dir, comp)); }
+    } else {
+        expandPattern(dir / comp, tail, files);
+    }
+}
+
+}  // namespace
+
+bool isSourceFileName(std::string_view file_name) {
+    static constexpr std::array<std::string_view, 11> extensions = {".c",   ".cc", ".cpp", ".cxx", ".c++", ".h",
+                                                                    ".hh", ".hpp", ".hxx", ".h++", ".inl"};
+    auto dot_pos = file_name.rfind('.');
+    return dot_pos != std::string::npos && uxs::contains(extensions, file_name.substr(dot_pos));
+}
+
+bool matchWildcard(std::string_view pattern, std::string_view name) {
+    std::size_t p = 0, n = 0, star_p = std::string_view::npos, star_n = 0;
+    while (n != name.size()) {
+        if (p != pattern.size() && (pattern[p] == '?' || pattern[p] == name[n])) {
+            ++p, ++n;
+        } else if (p != pattern.size() && pattern[p] == '*') {
+            star_p = p++, star_n = n;
+        } else if (star_p != std::string_view::npos) {
+            p = star_p + 1, n = ++star_n;
+        } else {
+            return false;
+        }
+    }
+    while (p != pattern.size() && pattern[p] == '*') { ++p; }
+    return p == pattern.size();
+}
+
+bool collectInputFiles(const std::vector<std::string>& args, std::vector<std::string>& files) {
+    std::vector<std::string> expanded;
+    for (const auto& arg : args) {
+        std::error_code ec;
+        if (hasWildcards(arg)) {
+            std::filesystem::path pattern(arg);
+            std::filesystem::path dir = pattern.root_path();
+            std::vector<std::string> components;
+            for (const auto& comp : pattern.relative_path()) {
+                if (!comp.empty()) { components.emplace_back(comp.string()); }
+            }
+            std::size_t size_before = expanded.size();
+            if (!components.empty()) { expandPattern(dir, components, expanded); }
+            if (expanded.size() == size_before) { printWarning("no input files match `{}`", arg); }
+        } else if (std::filesystem::is_directory(arg, ec)) {
+            collectDirectoryFiles(arg, expanded);
+        } else {
+            expanded.emplace_back(arg);
+        }
+    }
+
+    std::set<std::filesystem::path> unique_paths;
+    for (auto& file_name : expanded) {
+        if (unique_paths.emplace(std::filesystem::absolute(file_name).lexically_normal()).second) {
+            files.emplace_back(std::move(file_name));
+        }
+    }
+    return !files.empty();
+}
+
+bool parseLineRange(std::string_view s, std::pair<unsigned, unsigned>& range) {
+    if (!parseNumber(s, range.first) || !s.starts_with(':')) { return false; }
+    s.remove_prefix(1);
+    return parseNumber(s, range.second) && s.empty() && range.first != 0 && range.first <= range.second;
+}
+
+void parseUnifiedDiff(std::string_view diff, std::map<std::filesystem::path, LineRanges>& line_ranges) {
+    LineRanges* file_ranges = nullptr;
+    unsigned ln = 0, old_count = 0, new_count = 0;  // the current line of the new file and lines left in the hunk
+    while (!diff.empty()) {
+        auto nl_pos = diff.find('\n');
+        auto line = diff.substr(0, nl_pos);
+        diff.remove_prefix(nl_pos != std::string_view::npos ? nl_pos + 1 : diff.size());
+        if (line.ends_with('\r')) { line.remove_suffix(1); }
+
+        if (old_count != 0 || new_count != 0) {  // a line of the hunk
+            if (line.starts_with('+')) {
+                if (file_ranges) {
+                    if (!file_ranges->empty() && file_ranges->back().second + 1 == ln) {
+                        ++file_ranges->back().second;
+                    } else {
+                        file_ranges->emplace_back(ln, ln);
+                    }
+                }
+                ++ln, new_count -= new_count != 0;
+            } else if (line.starts_with('-')) {
+                old_count -= old_count != 0;
+            } else if (!line.starts_with('\\')) {  // not `\ No newline at end of file`
+                ++ln, new_count -= new_count != 0, old_count -= old_count != 0;
+            }
+        } else if (line.starts_with("+++ ")) {  // `+++ b/<path>[\t<time stamp>]`
+            auto path = line.substr(4, line.find('\t', 4) - 4);
+            file_ranges = nullptr;
+            if (path == "/dev/null") { continue; }
+            if (path.starts_with("b/")) { path.remove_prefix(2); }
+            file_ranges = &line_ranges[std::filesystem::absolute(path).lexically_normal()];
+        } else if (line.starts_with("@@ -")) {  // `@@ -<first>[,<count>] +<first>[,<count>] @@`
+            auto s = line.substr(4);
+            unsigned old_first = 0;
+            if (!parseHunkRange(s, old_first, old_count) || !s.starts_with(" +") ||
+                !parseHunkRange(s = s.substr(2), ln, new_count)) {
+                old_count = new_count = 0;
+            }
+        }
+    }
+}
@@ -0,0 +1,22 @@
+#pragma once
+
+#include <filesystem>
+#include <map>
+#include <string>
+#include <string_view>
+#include <vector>
+
+using LineRanges = std::vector<std::pair<unsigned, unsigned>>;  // ranges `[first, last]` of lines counted from 1
+
+bool isSourceFileName(std::string_view file_name);
+bool matchWildcard(std::string_view pattern, std::string_view name);
+
+// Expands directories (recursively, C/C++ sources only) and wildcard patterns (`*`, `?`, `**`), removes duplicates
+bool collectInputFiles(const std::vector<std::string>& args, std::vector<std::string>& files);
+
+// Parses a line range given as `<first>:<last>`
+bool parseLineRange(std::string_view s, std::pair<unsigned, unsigned>& range);
+
+// Collects added and changed lines of each new file of a unified diff; `b/` prefixes are dropped, paths are made
+// absolute and normal
+void parseUnifiedDiff(std::string_view diff, std::map<std::filesystem::path, LineRanges>& line_ranges);
@@ -1,96 +1,438 @@
+#include "arena.h"
+#include "compile_commands.h"
+#include "file_system_cache.h"
 #include "formatters.h"
+#include "include_cache.h"
+#include "input_files.h"
+#include "mapped_file.h"
 #include "print.h"
+#include "server.h"
+#include "stats.h"
+#include "thread_pool.h"
+#include "trace.h"
 
 #include <uxs/cli/parser.h>
 #include <uxs/io/filebuf.h>
 
+#include <algorithm>
+#include <chrono>
+#include <deque>
+#include <iostream>
+#include <iterator>
+#include <numeric>
+#include <random>
+
 #define XSTR(s) STR(s)
 #define STR(s)  #s
 
 namespace {
 
-std::pair<std::filesystem::path, IncludePathType> findIncludePath(const std::filesystem::path& path,
-                                                                  IncludeBrackets brackets,
-                                                                  const FormattingParameters& params,
-                                                                  const FormattingContext& ctx) {
-    if (path.empty()) { return {}; }
-    if (path.is_absolute()) {
-        if (std::filesystem::exists(path)) { return std::make_pair(path.lexically_normal(), IncludePathType::kCustom); }
-        return {};
-    }
-    if (brackets == IncludeBrackets::kDoubleQuotes) {
-        for (const auto& dir : uxs::make_reverse_range(ctx.path_stack)) {
-            auto path_cat = dir.parent_path() / path;
-            if (std::filesystem::exists(path_cat)) {
-                return std::make_pair((std::filesystem::current_path() / path_cat).lexically_normal(),
-                                      IncludePathType::kCustom);
+bool collectIndirectlyIncludedFiles(std::string_view file_name, const FormattingParameters& params,
+                                    FormattingContext& ctx, TokenBuffer* tokens = nullptr);
+
+void collectIncludedFile(const std::string& file_name, IncludeBrackets brackets, std::string_view parent_file_name,
+                         unsigned ln, const FormattingParameters& params, FormattingContext& ctx) {
+    auto [file_path, path_type] = findIncludePath(file_name, brackets, params, ctx);
+    if (!file_path.empty()) {
+        if (path_type == IncludePathType::kCustom) {
+            if (ctx.scanned_files) { ctx.scanned_files->insert(file_path); }
+            ctx.path_stack.emplace_back(file_path);
+            if (!collectIndirectlyIncludedFiles(file_name, params, ctx)) {
+                printWarning("{}:{}: could not open include file `{}`", parent_file_name, ln, file_name);
             }
+            ctx.path_stack.pop_back();
         }
+        if (ctx.path_stack.size() > 1) { ctx.indirectly_included_files.emplace(std::move(file_path)); }
+    } else {
+        printWarning("{}:{}: could not find included file `{}`", parent_file_name, ln, file_name);
+    }
+}
+
+struct ScanSnapshot {
+    std::size_t definition_count;
+    std::size_t once_included_count;
+    std::size_t message_count;
+};
+
+ScanSnapshot makeScanSnapshot(const FormattingContext& ctx) {
+    return {ctx.definitions.getSize(), ctx.once_included_log.size(), g_message_log ? g_message_log->messages.size() : 0};
+}
+
+void restoreScanSnapshot(FormattingContext& ctx, const ScanSnapshot& snapshot) {
+    ctx.definitions.restore(snapshot.definition_count);
+    while (ctx.once_included_log.size() > snapshot.once_included_count) {
+        ctx.once_included_files.erase(ctx.once_included_log.back());
+        ctx.once_included_log.pop_back();
     }
-    for (const auto& [dir, dir_type] : params.include_dirs) {
-        auto path_cat = dir / path;
-        if (std::filesystem::exists(path_cat)) {
-            return std::make_pair((std::filesystem::current_path() / path_cat).lexically_normal(), dir_type);
+    if (g_message_log) { g_message_log->messages.resize(snapshot.message_count); }
+}
+
+bool replayHeaderScan(std::string_view file_name, const HeaderScanResult& result, const FormattingParameters& params,
+                      FormattingContext& ctx) {
+    for (const auto& event : result.events) {
+        switch (event.type) {
+            case HeaderScanResult::EventType::kDefinition: ctx.addDefinition(event.text); break;
+            case HeaderScanResult::EventType::kCondition: {
+                if (ctx.isDefined(event.text) != event.flag) { return false; }
+            } break;
+            case HeaderScanResult::EventType::kPragmaOnce: {
+                if (!ctx.addOnceIncluded(ctx.path_stack.back())) { return true; }
+            } break;
+            case HeaderScanResult::EventType::kInclude: {
+                collectIncludedFile(event.text, event.flag ? IncludeBrackets::kAngled : IncludeBrackets::kDoubleQuotes,
+                                    file_name, event.line, params, ctx);
+            } break;
         }
     }
-    return {};
+    return true;
 }
 
+// Scans the file on the top of `ctx.path_stack`; `tokens` are given if the file is already tokenized
 bool collectIndirectlyIncludedFiles(std::string_view file_name, const FormattingParameters& params,
-                                    FormattingContext& ctx) {
-    std::string text;
-    if (uxs::filebuf ifile(ctx.path_stack.back().c_str(), "r"); ifile) {
-        std::size_t file_sz = static_cast<std::size_t>(ifile.seek(0, uxs::seekdir::end));
-        text.resize(file_sz);
-        ifile.seek(0);
-        text.resize(ifile.read(text));
-    } else {
-        return false;
+                                    FormattingContext& ctx, TokenBuffer* tokens) {
+    TRACE_SPAN("scan", ctx.path_stack.back());
+    auto* parent_result = std::exchange(ctx.scan_result, nullptr);
+
+    // Try to replay cached scan results of a header first
+    std::string cache_key;
+    if (ctx.include_scan_cache && ctx.path_stack.size() > 1) {
+        cache_key = IncludeScanCache::makeKey(ctx.include_config_key, ctx.path_stack.back());
+        for (const auto& cached_result : ctx.include_scan_cache->find(cache_key, ctx.path_stack.back())) {
+            auto snapshot = makeScanSnapshot(ctx);
+            if (replayHeaderScan(file_name, *cached_result, params, ctx)) {
+                ctx.include_scan_cache->countHit();
+                countStat(RunStats::Counter::kHeadersReplayed);
+                ctx.scan_result = parent_result;
+                return true;
+            }
+            restoreScanSnapshot(ctx, snapshot);
+        }
+        ctx.include_scan_cache->countMiss();
+    }
+
+    MappedFile file;
+    std::unique_ptr<TokenBuffer> file_tokens;
+    IncludeScanCache::FileInfo file_info;
+    bool has_file_info = false;
+    if (!tokens) {
+        // The header is stated before it is read: if it is replaced in between, the stored result is rejected later
+        if (!cache_key.empty()) { has_file_info = IncludeScanCache::getFileInfo(ctx.path_stack.back(), file_info); }
+        if (!file.open(ctx.path_stack.back()) || file.getData().size() > TokenBuffer::kMaxTextSize) {
+            ctx.scan_result = parent_result;
+            return false;
+        }
+        file_tokens = std::make_unique<TokenBuffer>(file.getData());
+        tokens = file_tokens.get();
     }
+    auto text = tokens->getText();
 
-    auto fn = [&params, &ctx](Parser& parser, const Parser::Token& token, unsigned skip_level, std::string&) {
+    HeaderScanResult result;
+    if (!cache_key.empty()) { ctx.scan_result = &result; }
+
+    auto fn = [&params, &ctx, &result](Parser& parser, const Parser::Token& token, unsigned skip_level, TextOutput&) {
         if (skip_level) { return false; }
 
         if (token.isPreprocIdentifier("pragma")) {
-            auto next = parser.parseNext();
-            if (next.type == Parser::TokenType::kPreprocBody) {
-                if (next.getTrimmedText() == "once" && !ctx.once_included_files.emplace(ctx.path_stack.back()).second) {
-                    return true;
+            if (parser.peek().type == Parser::TokenType::kPreprocBody) {
+                if (parser.parseNext().getTrimmedText() == "once") {
+                    if (ctx.scan_result) {
+                        result.events.emplace_back(HeaderScanResult::Event{HeaderScanResult::EventType::kPragmaOnce});
+                    }
+                    if (!ctx.addOnceIncluded(ctx.path_stack.back())) {
+                        result.is_complete = false;
+                        return true;
+                    }
                 }
-            } else {
-                parser.revert(next);
             }
         } else if (!token.isPreprocIdentifier("include")) {
             return false;
         }
 
-        auto next = parser.parseNext();
-        if (next.type == Parser::TokenType::kPreprocBody) {
+        if (parser.peek().type == Parser::TokenType::kPreprocBody) {
+            auto next = parser.parseNext();
             auto [file_name, brackets] = extractIncludePath(next.getTrimmedText());
-            auto [file_path, path_type] = findIncludePath(file_name, brackets, params, ctx);
-            if (!file_path.empty()) {
-                if (path_type == IncludePathType::kCustom) {
-                    ctx.path_stack.emplace_back(file_path);
-                    if (!collectIndirectlyIncludedFiles(file_name, params, ctx)) {
-                        printWarning("{}:{}: could not open include file `{}`", parser.getFileName(), parser.getLn(),
-                                     file_name);
-                    }
-                    ctx.path_stack.pop_back();
-                }
-                if (ctx.path_stack.size() > 1) { ctx.indirectly_included_files.emplace(std::move(file_path)); }
-            } else {
-                printWarning("{}:{}: could not find included file `{}`", parser.getFileName(), parser.getLn(),
-                             file_name);
+            unsigned ln = parser.getLine(next);
+            if (ctx.scan_result) {
+                result.events.emplace_back(HeaderScanResult::Event{HeaderScanResult::EventType::kInclude,
+                                                                   brackets == IncludeBrackets::kAngled, ln,
+                                                                   file_name});
             }
-        } else {
-            parser.revert(next);
+            collectIncludedFile(file_name, brackets, parser.getFileName(), ln, params, ctx);
         }
 
         return false;
     };
 
-    processText(std::string{file_name}, text, ctx, fn);
+    TextOutput output(text);
+    processText(file_name, *tokens, ctx, fn, output);
+    if (file_tokens) {
+        countStat(RunStats::Counter::kHeadersScanned);
+        countStat(RunStats::Counter::kTokens, file_tokens->getTokenCount());
+    }
+
+    ctx.scan_result = parent_result;
+    if (!cache_key.empty() && result.is_complete) {
+        ctx.include_scan_cache->add(cache_key, has_file_info ? &file_info : nullptr, text,
+                                    std::make_shared<HeaderScanResult>(std::move(result)));
+    }
+    return true;
+}
+
+// Replacement of an input file by its output
+struct FileReplacement {
+    std::filesystem::path file_path;
+    std::filesystem::path tmp_file_path;  // empty if there is nothing to replace
+    std::set<std::filesystem::path> scanned_files;
+};
+
+// The output refers to the mapped input file, so it is written to a temporary file which then replaces the input
+bool writeReplacement(const std::string& file_name, const TextOutput& output, FileReplacement& replacement) {
+    std::error_code ec;
+    replacement.file_path = std::filesystem::canonical(file_name, ec);  // replace the target of a symbolic link
+    if (ec) { replacement.file_path = file_name; }
+    replacement.tmp_file_path = replacement.file_path;
+    replacement.tmp_file_path += uxs::format(".{:x}.tmp", std::random_device{}());
+    if (!output.writeFile(replacement.tmp_file_path)) {
+        std::filesystem::remove(replacement.tmp_file_path, ec);
+        replacement.tmp_file_path.clear();
+        printError("could not open output file `{}`", file_name);
+        return false;
+    }
+    if (auto status = std::filesystem::status(replacement.file_path, ec); !ec) {
+        std::filesystem::permissions(replacement.tmp_file_path, status.permissions(), ec);
+    }
+    return true;
+}
+
+// Scan results of the replaced file are stale for the files fixed after it
+bool commitReplacement(const std::string& file_name, FileReplacement& replacement,
+                       IncludeScanCache& include_scan_cache, FileSystemCache& file_system_cache) {
+    std::error_code ec;
+    std::filesystem::rename(replacement.tmp_file_path, replacement.file_path, ec);
+    const bool success = !ec;
+    if (!success) {
+        std::filesystem::remove(replacement.tmp_file_path, ec);
+        printError("could not replace file `{}`", file_name);
+    }
+    replacement.tmp_file_path.clear();
+    include_scan_cache.invalidate(file_system_cache.makeAbsolute(file_name));
+    return success;
+}
+
+bool checkTextSize(std::string_view file_name, std::span<const char> text) {
+    if (text.size() <= TokenBuffer::kMaxTextSize) { return true; }
+    printError("input file `{}` is too large, it must be less than 4 GiB", file_name);
+    return false;
+}
+
+// Fixes `src_text` of the input file, only `line_ranges` if they are given
+void formatFile(const std::string& input_file_name, std::span<const char> src_text, const FormattingParameters& params,
+                const LineRanges* line_ranges, IncludeScanCache& include_scan_cache,
+                FileSystemCache& file_system_cache, TextOutput& output,
+                std::set<std::filesystem::path>* scanned_files = nullptr) {
+    FormattingContext ctx;
+
+    ctx.file_system_cache = &file_system_cache;
+    ctx.scanned_files = scanned_files;
+    ctx.path_stack.emplace_back(file_system_cache.makeAbsolute(input_file_name));
+
+    // Transient data of tokenizing and fixing is allocated from the arena of the thread, which is reset for each file
+    thread_local Arena arena;
+    arena.reset();
+
+    // The input file is tokenized once for the include scan and all fixes
+    TokenBuffer tokens(src_text, TextProcFlags::kAtBegOfLine, &arena);
+    if (line_ranges) { tokens.setFixRanges(*line_ranges); }
+    if (params.lex_thread_count > 1) {  // otherwise tokens are lexed on demand
+        TRACE_SPAN("lex");
+        tokens.lexAll(params.lex_thread_count);
+    }
+
+    ctx.definitions.assign(params.definitions);
+    const std::size_t param_definition_count = ctx.definitions.getSize();
+
+    if (params.remove_already_included) {
+        PhaseTimer timer(RunStats::Phase::kIncludeScan);
+        TRACE_SPAN("include scan");
+        ctx.include_scan_cache = &include_scan_cache;
+        ctx.include_config_key = IncludeScanCache::makeIncludeConfigKey(params);
+        // Collect messages to be able to drop the ones of rolled back cache replays
+        MessageLog scan_log;
+        auto* log = std::exchange(g_message_log, &scan_log);
+        collectIndirectlyIncludedFiles(input_file_name, params, ctx, &tokens);
+        g_message_log = log;
+        for (auto& [is_error, msg] : scan_log.messages) { printMessage(is_error, std::move(msg)); }
+    }
+
+    ctx.definitions.restore(param_definition_count);
+    {
+        PhaseTimer timer(RunStats::Phase::kFixing);
+        TRACE_SPAN("fixing");
+        formatText(input_file_name, tokens, params, ctx, output);
+        if (params.fix_file_ending && tokens.isInFixRange(src_text.size())) { output.append("\n"); }
+    }
+
+    countStat(RunStats::Counter::kTokens, tokens.getTokenCount());
+    countStat(RunStats::Counter::kOutputBytes, output.getSize());
+
+    printDebug(1, "-------------- included files:");
+    for (const auto& [file_path, ln] : ctx.included_files) {
+        printDebug(1, "include:{}: {}", ln, file_path.generic_string());
+    }
+    printDebug(1, "-------------- indirectly included files:");
+    for (const auto& file_path : ctx.indirectly_included_files) {
+        printDebug(1, "include: {}", file_path.generic_string());
+    }
+    printDebug(1, "-------------- definitions: {} lookups, {} names interned", ctx.definitions.getLookupCount(),
+               ctx.definitions.getSymbolCount());
+    printDebug(1, "-------------- tokens: {}", tokens.getTokenCount());
+    printDebug(1, "-------------- arena: {} allocations, {} bytes", arena.getAllocCount(), arena.getAllocSize());
+}
+
+// Reports the first place to fix in check mode, returns `false` if there is one
+bool reportFirstChange(const std::string& input_file_name, std::span<const char> src_text, const TextOutput& output) {
+    if (output.isEqualToSource()) { return true; }
+    auto offset = output.findFirstChange();
+    auto ln = 1 + std::count(src_text.begin(), src_text.begin() + offset, '\n');
+    printInfo("{}:{}: needs fixing", input_file_name, ln);
+    return false;
+}
+
+// Fixes only `line_ranges` if they are given. If `deferred` is given, a changed input file is left as is until its
+// replacement is committed, and the replacement gets the headers read by the include scan
+bool processFile(const std::string& input_file_name, const std::string& output_file_name,
+                 const FormattingParameters& params, const LineRanges* line_ranges,
+                 IncludeScanCache& include_scan_cache, FileSystemCache& file_system_cache,
+                 FileReplacement* deferred = nullptr) {
+    TRACE_SPAN("file", input_file_name);
+    MappedFile input_file;
+    {
+        PhaseTimer timer(RunStats::Phase::kRead);
+        TRACE_SPAN("read");
+        if (!input_file.open(input_file_name)) {
+            printError("could not open input file `{}`", input_file_name);
+            return false;
+        }
+    }
+    auto src_text = input_file.getData();
+    if (!checkTextSize(input_file_name, src_text)) { return false; }
+    countStat(RunStats::Counter::kFiles);
+    countStat(RunStats::Counter::kBytes, src_text.size());
+
+    printInfo("Processing: {}...", input_file_name);
+
+    TextOutput output(src_text, params.check_only);
+    formatFile(input_file_name, src_text, params, line_ranges, include_scan_cache, file_system_cache, output,
+               deferred ? &deferred->scanned_files : nullptr);
+
+    auto replace_input_file = [&] {
+        FileReplacement replacement;
+        if (!writeReplacement(input_file_name, output, deferred ? *deferred : replacement)) { return false; }
+        if (deferred) { return true; }
+        input_file.close();
+        return commitReplacement(input_file_name, replacement, include_scan_cache, file_system_cache);
+    };
+
+    PhaseTimer timer(RunStats::Phase::kWrite);
+    TRACE_SPAN("write");
+    if (params.check_only) {
+        return reportFirstChange(input_file_name, src_text, output);
+    } else if (!output_file_name.empty()) {
+        std::error_code ec;
+        if (std::filesystem::equivalent(output_file_name, input_file_name, ec)) {
+            return replace_input_file();
+        } else if (!output.writeFile(output_file_name)) {
+            printError("could not open output file `{}`", output_file_name);
+            return false;
+        }
+    } else if (!output.isEqualToSource()) {
+        return replace_input_file();
+    }
+    return true;
+}
+
+// Gives each file the parameters of its compile command, other files keep `params`. Files with equal definitions and
+// include directories share parameters and are placed together, so results of header scans computed for the first file
+// of a group are replayed for the others. Returns the number of groups
+std::size_t applyCompileCommands(const std::vector<CompileCommand>& commands, const FormattingParameters& params,
+                                 std::vector<std::string>& file_names,
+                                 std::vector<const FormattingParameters*>& file_params,
+                                 std::deque<FormattingParameters>& groups) {
+    std::map<std::filesystem::path, const CompileCommand*> command_by_path;
+    for (const auto& command : commands) { command_by_path.emplace(command.file_path, &command); }  // the first wins
+
+    std::map<std::string, std::size_t> group_by_key;
+    std::vector<std::size_t> file_groups(file_names.size(), 0);  // 0 is for files which are not in the database
+    for (std::size_t n = 0; n != file_names.size(); ++n) {
+        auto it = command_by_path.find(std::filesystem::absolute(file_names[n]).lexically_normal());
+        if (it == command_by_path.end()) { continue; }
+
+        // Definitions and directories of the command line are added to the ones of the compile command
+        FormattingParameters group_params = params;
+        const auto& command = *it->second;
+        group_params.definitions = command.definitions;
+        group_params.definitions.insert(group_params.definitions.end(), params.definitions.begin(),
+                                        params.definitions.end());
+        std::sort(group_params.definitions.begin(), group_params.definitions.end());
+        group_params.definitions.erase(std::unique(group_params.definitions.begin(), group_params.definitions.end()),
+                                       group_params.definitions.end());
+        group_params.include_dirs = command.include_dirs;
+        group_params.include_dirs.insert(group_params.include_dirs.end(), params.include_dirs.begin(),
+                                         params.include_dirs.end());
+
+        std::string key = IncludeScanCache::makeIncludeConfigKey(group_params);
+        for (const auto& definition : group_params.definitions) {
+            key += 'D';
+            key += definition;
+            key.push_back('\0');
+        }
+
+        auto [group_it, is_new] = group_by_key.emplace(std::move(key), groups.size() + 1);
+        if (is_new) { groups.emplace_back(std::move(group_params)); }
+        file_groups[n] = group_it->second;
+    }
 
+    std::vector<std::size_t> order(file_names.size());
+    std::iota(order.begin(), order.end(), 0);
+    std::stable_sort(order.begin(), order.end(),
+                     [&file_groups](std::size_t lhs, std::size_t rhs) { return file_groups[lhs] < file_groups[rhs]; });
+
+    std::vector<std::string> sorted_file_names;
+    sorted_file_names.reserve(file_names.size());
+    file_params.clear();
+    for (std::size_t n : order) {
+        sorted_file_names.emplace_back(std::move(file_names[n]));
+        file_params.push_back(file_groups[n] ? &groups[file_groups[n] - 1] : &params);
+    }
+    file_names = std::move(sorted_file_names);
+    return groups.size();
+}
+
+// Caches are kept between requests, but their entries are checked for changes once per request
+bool handleServerRequest(const ServerRequest& request, std::string& fixed_text, IncludeScanCache& include_scan_cache,
+                         FileSystemCache& file_system_cache) {
+    include_scan_cache.recheck();
+    file_system_cache.recheck();
+
+    MappedFile input_file;
+    std::span<const char> src_text;
+    if (request.text) {
+        src_text = *request.text;
+    } else if (input_file.open(request.file_name)) {
+        src_text = input_file.getData();
+    } else {
+        printError("could not open input file `{}`", request.file_name);
+        return false;
+    }
+    if (!checkTextSize(request.file_name, src_text)) { return false; }
+
+    const auto& params = request.params;
+    TextOutput output(src_text, params.check_only);
+    formatFile(request.file_name, src_text, params, !request.line_ranges.empty() ? &request.line_ranges : nullptr,
+               include_scan_cache, file_system_cache, output);
+
+    if (params.check_only) { return reportFirstChange(request.file_name, src_text, output); }
+    fixed_text = output.str();
     return true;
 }
 
@@ -98,13 +440,17 @@ bool collectIndirectlyIncludedFiles(std::string_view file_name, const Formatting
 
 int main(int argc, char** argv) {
     bool show_help = false, show_version = false;
-    std::string input_file_name, output_file_name;
+    std::vector<std::string> input_file_names;
+    std::string output_file_name, cache_dir, socket_path, compile_commands_file_name, stats_format, trace_file_name;
+    unsigned job_count = std::thread::hardware_concurrency();
+    LineRanges line_ranges;
+    bool lines_from_diff = false;
 
     FormattingParameters params;
 
     auto cli = uxs::cli::command(argv[0])
                << uxs::cli::overview("This is a tool to automate cosmetic fixes in C and C++ code")
-               << uxs::cli::value("file", input_file_name)
+               << uxs::cli::values("<files>...", input_file_names)
                << (uxs::cli::option({"-o"}) & uxs::cli::value("<file>", output_file_name)) % "Output file name."
                << uxs::cli::option({"--fix-file-ending"}).set(params.fix_file_ending) %
                       "Change file ending to one new-line symbol."
@@ -116,6 +462,18 @@ int main(int argc, char** argv) {
                       "Fix pragma once preproc command."
                << uxs::cli::option({"--remove-already-included"}).set(params.remove_already_included) %
                       "Remove include directives for already included headers."
+               << uxs::cli::option({"--check"}).set(params.check_only) %
+                      "Only check if files need fixing, report the first place to fix."
+               << (uxs::cli::option({"--lines"}) & uxs::cli::basic_value_wrapper<char>(
+                                                      "<first>:<last>...",
+                                                      [&line_ranges](std::string_view s) {
+                                                          return parseLineRange(s, line_ranges.emplace_back());
+                                                      })
+                                                      .multiple()) %
+                      "Fix only the given line ranges, can be repeated."
+               << uxs::cli::option({"--lines-from-diff"}).set(lines_from_diff) %
+                      "Read a unified diff from standard input,\n"
+                      "fix only lines added or changed by it."
                << (uxs::cli::option({"-D"}) & uxs::cli::values("<defs>...", params.definitions)) % "Add definition."
                << (uxs::cli::option({"-I"}) & uxs::cli::basic_value_wrapper<char>(
                                                   "<dirs>...",
@@ -133,6 +491,24 @@ int main(int argc, char** argv) {
                                                    })
                                                    .multiple()) %
                       "Add system include directory."
+               << (uxs::cli::option({"--compile-commands"}) & uxs::cli::value("<file>", compile_commands_file_name)) %
+                      "Take definitions and include directories of files\n"
+                      "from a compilation database, fix all its files\n"
+                      "if no input files are given."
+               << (uxs::cli::option({"--cache-dir"}) & uxs::cli::value("<dir>", cache_dir)) %
+                      "Directory for persistent include scan cache."
+               << (uxs::cli::option({"--serve"}) & uxs::cli::value("<socket>", socket_path)) %
+                      "Serve fixing requests on a Unix domain socket."
+               << (uxs::cli::option({"--stats"}) & uxs::cli::value("<format>", stats_format)) %
+                      "Print phase times and counters of the run,\n"
+                      "the format is `text` or `json`."
+               << (uxs::cli::option({"--trace-file"}) & uxs::cli::value("<file>", trace_file_name)) %
+                      "Write Chrome trace events of files and phases."
+               << (uxs::cli::option({"--lex-threads"}) & uxs::cli::value("<count>", params.lex_thread_count)) %
+                      "Number of threads lexing each large file\n"
+                      "(from 512 KiB) in chunks."
+               << (uxs::cli::option({"-j", "--jobs"}) & uxs::cli::value("<count>", job_count)) %
+                      "Number of files processed in parallel."
                << (uxs::cli::option({"-d"}) & uxs::cli::value("<debug level>", g_debug_level)) % "Debug level."
                << uxs::cli::option({"-h", "--help"}).set(show_help) % "Display this information."
                << uxs::cli::option({"-V", "--version"}).set(show_version) % "Display version.";
@@ -144,7 +520,9 @@ int main(int argc, char** argv) {
     } else if (show_version) {
         uxs::println(uxs::stdbuf::out(), "{}", XSTR(VERSION));
         return 0;
-    } else if (parse_result.status != uxs::cli::parsing_status::ok) {
+    } else if (parse_result.status != uxs::cli::parsing_status::ok &&
+               (parse_result.status != uxs::cli::parsing_status::unspecified_value ||
+                (socket_path.empty() && compile_commands_file_name.empty()))) {
         switch (parse_result.status) {
             case uxs::cli::parsing_status::unknown_option: {
                 printError("unknown command line option `{}`", argv[parse_result.argc_parsed]);
@@ -157,105 +535,188 @@ int main(int argc, char** argv) {
                 }
             } break;
             case uxs::cli::parsing_status::unspecified_value: {
-                if (input_file_name.empty()) { printError("no input file specified"); }
+                if (input_file_names.empty()) { printError("no input file specified"); }
             } break;
             default: break;
         }
         return -1;
     }
 
-    std::string full_text;
-    if (uxs::filebuf ifile(input_file_name.c_str(), "r"); ifile) {
-        std::size_t file_sz = static_cast<std::size_t>(ifile.seek(0, uxs::seekdir::end));
-        full_text.resize(file_sz);
-        ifile.seek(0);
-        full_text.resize(ifile.read(full_text));
-    } else {
-        printError("could not open input file `{}`", input_file_name);
+    if (!stats_format.empty() && stats_format != "text" && stats_format != "json") {
+        printError("unknown statistics format `{}`", stats_format);
         return -1;
     }
 
-    uxs::println("Processing: {}...", input_file_name);
+#if !defined(USE_TRACING)
+    if (!trace_file_name.empty()) {
+        printError("tracing is not supported by this build, it is enabled by `USE_TRACING` definition");
+        return -1;
+    }
+#endif
 
-    FormattingContext ctx;
-    std::string src_full_text = full_text;
+    FileSystemCache file_system_cache;
+    IncludeScanCache include_scan_cache;
+    if (!cache_dir.empty()) { include_scan_cache.setCacheDir(cache_dir); }
 
-    ctx.path_stack.emplace_back((std::filesystem::current_path() / input_file_name).lexically_normal());
+    if (!socket_path.empty()) {
+        if (!input_file_names.empty() || !output_file_name.empty() || !line_ranges.empty() || lines_from_diff) {
+            printError("input and output files and line ranges are given by requests in server mode");
+            return -1;
+        } else if (!stats_format.empty() || !trace_file_name.empty()) {
+            printError("statistics and traces can't be collected in server mode");
+            return -1;
+        }
+        serve(socket_path, std::max(1u, job_count),
+              [&include_scan_cache, &file_system_cache](const ServerRequest& request, std::string& fixed_text) {
+                  return handleServerRequest(request, fixed_text, include_scan_cache, file_system_cache);
+              });
+        return -1;  // the server returns only on failure
+    }
 
-    if (params.remove_already_included) {
-        ctx.definitions = params.definitions;
-        collectIndirectlyIncludedFiles(input_file_name, params, ctx);
+    std::vector<CompileCommand> compile_commands;
+    if (!compile_commands_file_name.empty() && !readCompileCommands(compile_commands_file_name, compile_commands)) {
+        return -1;
     }
 
-    if (params.fix_id_naming) {
-        ctx.definitions = params.definitions;
-        full_text = processText(input_file_name, full_text, ctx,
-                                [&params](Parser& parser, const Parser::Token& token, unsigned, std::string& output) {
-                                    fixIdNaming(parser, token, params, output);
-                                    return false;
-                                });
+    std::vector<std::string> file_names;
+    if (!input_file_names.empty() || compile_commands_file_name.empty()) {
+        collectInputFiles(input_file_names, file_names);
+    } else {
+        std::set<std::filesystem::path> database_files;  // all files of the database are fixed
+        for (const auto& command : compile_commands) {
+            if (database_files.insert(command.file_path).second) {
+                file_names.emplace_back(command.file_path.string());
+            }
+        }
     }
 
-    auto fn = [&params, &ctx](Parser& parser, const Parser::Token& token, unsigned skip_level, std::string& output) {
-        static constexpr std::array<std::string_view, 9> type_names = {
-            "kEof", "kSymbol", "kIdentifier", "kString", "kInteger", "kReal", "kPreprocId", "kPreprocBody", "kComment"};
+    if (file_names.empty()) {
+        printError("no input files found");
+        return -1;
+    } else if (!output_file_name.empty() && file_names.size() > 1) {
+        printError("output file name can be specified only for one input file");
+        return -1;
+    } else if (!output_file_name.empty() && params.check_only) {
+        printError("output file name can't be specified in check mode");
+        return -1;
+    } else if (!line_ranges.empty() && lines_from_diff) {
+        printError("line ranges can't be specified together with a diff");
+        return -1;
+    }
 
-        if (!skip_level) {
-            printDebug(2, "token: {}, ws_count = {}: {:?}", type_names[static_cast<unsigned>(token.type)],
-                       token.ws_count, token.getTrimmedText());
-        }
+    // Each file is fixed only in its ranges of the diff, files which are not in the diff are left as is
+    static const LineRanges no_line_ranges;
+    std::map<std::filesystem::path, LineRanges> diff_line_ranges;
+    if (lines_from_diff) {
+        parseUnifiedDiff(std::string{std::istreambuf_iterator<char>{std::cin}, {}}, diff_line_ranges);
+    }
+    auto get_line_ranges = [&](const std::string& file_name) -> const LineRanges* {
+        if (!lines_from_diff) { return !line_ranges.empty() ? &line_ranges : nullptr; }
+        auto it = diff_line_ranges.find(std::filesystem::absolute(file_name).lexically_normal());
+        return it != diff_line_ranges.end() ? &it->second : &no_line_ranges;
+    };
 
-        if (token.isEof() && params.fix_file_ending) { return false; }
+    std::vector<const FormattingParameters*> file_params(file_names.size(), &params);
+    std::deque<FormattingParameters> param_groups;
+    if (!compile_commands_file_name.empty()) {
+        std::size_t group_count = applyCompileCommands(compile_commands, params, file_names, file_params, param_groups);
+        printDebug(1, "-------------- compilation database: {} commands, {} configurations", compile_commands.size(),
+                   group_count);
+    }
 
-        if (params.fix_pragma_once && fixPragmaOnce(parser, token, output)) { return false; }
-        if (params.fix_single_statement && fixSingleStatement(parser, token, output)) { return false; }
+    RunStats run_stats;
+    if (!stats_format.empty()) { g_run_stats = &run_stats; }
+#if defined(USE_TRACING)
+    Tracer tracer;
+    if (!trace_file_name.empty()) { g_tracer = &tracer; }
+#endif
+    auto start_time = std::chrono::steady_clock::now();
+
+    bool success = true;
+    job_count = std::min<unsigned>(std::max(1u, job_count), static_cast<unsigned>(file_names.size()));
+    if (job_count == 1) {
+        for (std::size_t n = 0; n != file_names.size(); ++n) {
+            success &= processFile(file_names[n], output_file_name, *file_params[n], get_line_ranges(file_names[n]),
+                                   include_scan_cache, file_system_cache);
+        }
+    } else {
+        // Files are fixed by the pool in any order against the original input files, then their replacements are
+        // committed and messages are flushed in the order of input files. A file which has read an input file
+        // replaced before it is fixed again, so the results are the same as of fixing the files one by one
+        std::vector<MessageLog> logs(file_names.size());
+        std::vector<FileReplacement> replacements(file_names.size());
+        std::vector<std::future<bool>> results;
+        results.reserve(file_names.size());
+
+        ThreadPool pool(job_count);
+        for (std::size_t n = 0; n != file_names.size(); ++n) {
+            results.emplace_back(pool.submit([&file_name = file_names[n], &log = logs[n], &params = *file_params[n],
+                                                 file_line_ranges = get_line_ranges(file_names[n]), &include_scan_cache,
+                                                 &file_system_cache, &replacement = replacements[n]] {
+                g_message_log = &log;
+                bool result = processFile(file_name, {}, params, file_line_ranges, include_scan_cache,
+                                          file_system_cache, &replacement);
+                g_message_log = nullptr;
+                return result;
+            }));
+        }
 
-        if (token.isPreprocIdentifier("include")) {
-            auto next = parser.parseNext();
-            if (next.type == Parser::TokenType::kPreprocBody) {
-                if (!skip_level) {
-                    auto [file_name, brackets] = extractIncludePath(next.getTrimmedText());
-                    auto [file_path, path_type] = findIncludePath(file_name, brackets, params, ctx);
-                    if (!file_path.empty()) {
-                        if (params.remove_already_included &&
-                            (uxs::find_if(ctx.included_files, uxs::is_equal_to(file_path)).second ||
-                             uxs::find(ctx.indirectly_included_files, file_path).second)) {
-                            skipLine(parser, token, output);
-                            return false;
-                        }
-                        ctx.included_files.emplace_back(std::move(file_path), token.line);
-                    }
-                }
+        // No file is replaced while others are still read
+        std::vector<char> file_results(file_names.size());
+        for (std::size_t n = 0; n != file_names.size(); ++n) { file_results[n] = results[n].get(); }
+
+        std::set<std::filesystem::path> replaced_files;
+        for (std::size_t n = 0; n != file_names.size(); ++n) {
+            auto& replacement = replacements[n];
+            if (std::any_of(replacement.scanned_files.begin(), replacement.scanned_files.end(),
+                            [&replaced_files](const auto& file_path) { return replaced_files.count(file_path); })) {
+                std::error_code ec;
+                if (!replacement.tmp_file_path.empty()) { std::filesystem::remove(replacement.tmp_file_path, ec); }
+                replacement = {};
+                logs[n] = {};
+                countStat(RunStats::Counter::kFilesRefixed);
+                g_message_log = &logs[n];
+                file_results[n] = processFile(file_names[n], {}, *file_params[n], get_line_ranges(file_names[n]),
+                                              include_scan_cache, file_system_cache, &replacement);
+                g_message_log = nullptr;
+            }
+            if (file_results[n] && !replacement.tmp_file_path.empty()) {
+                g_message_log = &logs[n];
+                file_results[n] = commitReplacement(file_names[n], replacement, include_scan_cache, file_system_cache);
+                g_message_log = nullptr;
+                if (file_results[n]) { replaced_files.emplace(file_system_cache.makeAbsolute(file_names[n])); }
             }
-            parser.revert(next);
+            success &= file_results[n] != 0;
+            logs[n].flush();
         }
+    }
 
-        output.append(token.text);
-        return false;
-    };
-
-    ctx.definitions = params.definitions;
-    full_text = processText(input_file_name, full_text, ctx, fn);
-
-    if (params.fix_file_ending) { full_text.push_back('\n'); }
-
-    printDebug(1, "-------------- included files:");
-    for (const auto& [file_path, ln] : ctx.included_files) {
-        printDebug(1, "include:{}: {}", ln, file_path.generic_string());
+    if (params.remove_already_included) {
+        printDebug(1, "-------------- include scan cache: {} hits ({} loaded), {} misses",
+                   include_scan_cache.getHitCount(), include_scan_cache.getLoadCount(),
+                   include_scan_cache.getMissCount());
     }
-    printDebug(1, "-------------- indirectly included files:");
-    for (const auto& file_path : ctx.indirectly_included_files) {
-        printDebug(1, "include: {}", file_path.generic_string());
+    printDebug(1, "-------------- file system cache: {} probes, {} directories listed, {} file system calls",
+               file_system_cache.getProbeCount(), file_system_cache.getListingCount(),
+               file_system_cache.getFileSystemCallCount());
+
+    if (g_run_stats) {
+        auto wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() -
+                                                                              start_time);
+        run_stats.add(RunStats::Counter::kIncludeProbes, file_system_cache.getProbeCount());
+        uxs::stdbuf::out().write(stats_format == "json" ? run_stats.formatJson(wall_time) :
+                                                          run_stats.format(wall_time));
+        g_run_stats = nullptr;
     }
 
-    if (!output_file_name.empty() || full_text != src_full_text) {
-        if (output_file_name.empty()) { output_file_name = input_file_name; }
-        if (uxs::filebuf ofile(output_file_name.c_str(), "w"); ofile) {
-            ofile.write(full_text);
-        } else {
-            printError("could not open output file `{}`", output_file_name);
+#if defined(USE_TRACING)
+    if (g_tracer) {
+        g_tracer = nullptr;
+        if (!tracer.writeFile(trace_file_name)) {
+            printError("could not write trace file `{}`", trace_file_name);
             return -1;
         }
     }
-    return 0;
+#endif
+    return success ? 0 : -1;
 }
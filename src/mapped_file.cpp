@@ -0,0 +1,108 @@
+#include "mapped_file.h"
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    define NOMINMAX
+#    include <windows.h>
+#else
+#    include <fcntl.h>
+#    include <sys/mman.h>
+#    include <sys/stat.h>
+#    include <unistd.h>
+
+#    include <cerrno>
+#endif
+
+namespace {
+constexpr std::size_t kReadChunkSize = 65536;
+}  // namespace
+
+#if defined(_WIN32)
+
+bool MappedFile::open(const std::filesystem::path& file_path) {
+    close();
+    HANDLE file = ::CreateFileW(file_path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_WRITE | FILE_SHARE_DELETE,
+                                nullptr, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, nullptr);
+    if (file == INVALID_HANDLE_VALUE) { return false; }
+
+    LARGE_INTEGER file_size{};
+    if (::GetFileType(file) == FILE_TYPE_DISK && ::GetFileSizeEx(file, &file_size) && file_size.QuadPart > 0) {
+        if (HANDLE mapping = ::CreateFileMappingW(file, nullptr, PAGE_READONLY, 0, 0, nullptr); mapping) {
+            mapping_ = ::MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0);
+            ::CloseHandle(mapping);  // the view keeps the mapping object alive
+            if (mapping_) {
+                ::CloseHandle(file);
+                data_ = std::span(static_cast<const char*>(mapping_), static_cast<std::size_t>(file_size.QuadPart));
+                return true;
+            }
+        }
+    }
+
+    std::size_t size = 0;
+    bool success = true;
+    while (true) {
+        if (buffer_.size() - size < kReadChunkSize) { buffer_.resize(size + kReadChunkSize); }
+        DWORD n_read = 0;
+        if (!::ReadFile(file, buffer_.data() + size, static_cast<DWORD>(buffer_.size() - size), &n_read, nullptr)) {
+            success = ::GetLastError() == ERROR_BROKEN_PIPE;  // the write end of a pipe is closed
+            break;
+        }
+        if (n_read == 0) { break; }
+        size += n_read;
+    }
+    ::CloseHandle(file);
+    buffer_.resize(size);
+    data_ = buffer_;
+    return success;
+}
+
+void MappedFile::close() {
+    if (mapping_) { ::UnmapViewOfFile(mapping_), mapping_ = nullptr; }
+    buffer_.clear();
+    data_ = {};
+}
+
+#else  // defined(_WIN32)
+
+bool MappedFile::open(const std::filesystem::path& file_path) {
+    close();
+    int fd = ::open(file_path.c_str(), O_RDONLY | O_CLOEXEC);
+    if (fd < 0) { return false; }
+
+    struct stat st {};
+    if (::fstat(fd, &st) == 0 && S_ISREG(st.st_mode) && st.st_size > 0) {
+        void* mapping = ::mmap(nullptr, static_cast<std::size_t>(st.st_size), PROT_READ, MAP_PRIVATE, fd, 0);
+        if (mapping != MAP_FAILED) {
+            ::close(fd);
+            mapping_ = mapping;
+            data_ = std::span(static_cast<const char*>(mapping_), static_cast<std::size_t>(st.st_size));
+            return true;
+        }
+    }
+
+    std::size_t size = 0;
+    bool success = true;
+    while (true) {
+        if (buffer_.size() - size < kReadChunkSize) { buffer_.resize(size + kReadChunkSize); }
+        auto n_read = ::read(fd, buffer_.data() + size, buffer_.size() - size);
+        if (n_read < 0) {
+            if (errno == EINTR) { continue; }
+            success = false;
+            break;
+        }
+        if (n_read == 0) { break; }
+        size += static_cast<std::size_t>(n_read);
+    }
+    ::close(fd);
+    buffer_.resize(size);
+    data_ = buffer_;
+    return success;
+}
+
+void MappedFile::close() {
+    if (mapping_) { ::munmap(mapping_, data_.size()), mapping_ = nullptr; }
+    buffer_.clear();
+    data_ = {};
+}
+
+#endif  // defined(_WIN32)
@@ -0,0 +1,24 @@
+#pragma once
+
+#include <filesystem>
+#include <span>
+#include <string>
+
+// Read-only contents of a file: regular files are mapped into memory, others (e.g. pipes) are read into a buffer
+class MappedFile {
+ public:
+    MappedFile() = default;
+    ~MappedFile() { close(); }
+    MappedFile(const MappedFile&) = delete;
+    MappedFile& operator=(const MappedFile&) = delete;
+
+    bool open(const std::filesystem::path& file_path);
+    void close();
+    bool isMapped() const { return mapping_ != nullptr; }
+    std::span<const char> getData() const { return data_; }
+
+ private:
+    std::span<const char> data_;
+    void* mapping_ = nullptr;
+    std::string buffer_;
+};
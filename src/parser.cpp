@@ -1,10 +1,86 @@
 #include "parser.h"
 
+#include "print.h"
+#include "stats.h"
+#include "text_scan.h"
+
+#include <thread>
+
 namespace lex_detail {
+#if defined(__GNUC__)
+#    pragma GCC diagnostic push
+#    pragma GCC diagnostic ignored "-Wunused-function"  // generated `lex` is replaced with `lexLongest`
+#endif
 #include "lex_analyzer.inl"
+#if defined(__GNUC__)
+#    pragma GCC diagnostic pop
+#endif
+
+#if defined(USE_DENSE_LEX_TABLES)
+// Transitions of generated compressed tables expanded to a state-by-meta-class matrix, so that each symbol costs two
+// table loads without the default state chain
+struct DenseTables {
+    static constexpr std::size_t kStateCount = sizeof(accept) / sizeof(accept[0]);
+    static constexpr std::uint8_t kNoTransition = 0xff;
+    static_assert(kStateCount < kNoTransition);
+    std::size_t meta_count = 0;
+    std::vector<std::uint8_t> next_state;
+
+    DenseTables() {
+        meta_count = 1 + *std::max_element(std::begin(symb2meta), std::end(symb2meta));
+        next_state.resize(kStateCount * meta_count, kNoTransition);
+        for (std::size_t n = 0; n != kStateCount; ++n) {
+            for (std::size_t meta = 0; meta != meta_count; ++meta) {
+                int state = static_cast<int>(n);
+                do {
+                    int l = base[state] + static_cast<int>(meta);
+                    if (check[l] == state) {
+                        next_state[n * meta_count + meta] = static_cast<std::uint8_t>(next[l]);
+                        break;
+                    }
+                    state = def[state];
+                } while (state >= 0);
+            }
+        }
+    }
+};
+
+const DenseTables g_dense_tables;
+
+inline int transition(int state, char ch) {
+    std::uint8_t next = g_dense_tables.next_state[state * g_dense_tables.meta_count +
+                                                  symb2meta[static_cast<unsigned char>(ch)]];
+    return next != DenseTables::kNoTransition ? next : -1;
+}
+#else   // defined(USE_DENSE_LEX_TABLES)
+inline int transition(int state, char ch) {
+    uint8_t meta = symb2meta[static_cast<unsigned char>(ch)];
+    do {
+        int l = base[state] + meta;
+        if (check[l] == state) { return next[l]; }
+        state = def[state];
+    } while (state >= 0);
+    return -1;
 }
+#endif  // defined(USE_DENSE_LEX_TABLES)
+
+// The same as generated `lex` function, but remembers only the last accepting position instead of the state for each
+// analyzed symbol, so it needs no state stack and its memory traffic doesn't depend on lexeme length
+int lexLongest(const char* first, const char* last, int sc, std::size_t& llen) {
+    if (first == last) { return err_end_of_input; }
+    int pat = predef_pat_default;
+    llen = 1;  // accept at least one symbol as default pattern
+    int state = sc;
+    for (const char* p = first; p != last;) {
+        if ((state = transition(state, *p++)) < 0) { break; }
+        if (accept[state] > 0) { pat = accept[state], llen = static_cast<std::size_t>(p - first); }
+    }
+    return pat;
+}
+}  // namespace lex_detail
 
 unsigned g_debug_level = 0;
+thread_local MessageLog* g_message_log = nullptr;
 
 namespace {
 std::size_t countWs(std::string_view text) {
@@ -18,87 +94,444 @@ std::size_t countWs(std::string_view text) {
     }
     return count;
 }
-}  // namespace
 
-Parser::Token Parser::parseNext() {
-    if (!revert_stack_.empty()) {
-        auto token = revert_stack_.back();
-        revert_stack_.pop_back();
-        return token;
+bool makeFixedIdName(std::string_view id, std::pmr::string& new_id) {
+    if (id.size() <= 1) { return false; }
+    if (id[0] != '_') {
+        if (uxs::is_upper(id[0]) || (id[0] == 'k' && uxs::is_upper(id[1]))) { return false; }  // Probably enum member
+        if (uxs::all_of(id, [](char ch) { return ch == '_' || uxs::is_digit(ch) || uxs::is_lower(ch); })) {
+            return false;  // No upper case
+        }
+        if (uxs::all_of(id, [](char ch) { return ch == '_' || uxs::is_digit(ch) || uxs::is_upper(ch); })) {
+            return false;  // No lower case
+        }
+    }
+    bool is_member = false;
+    if (id[0] == '_') {
+        is_member = true;
+        id = id.substr(1);
     }
+    new_id.push_back(id[0]);
+    for (auto it = id.begin() + 1; it != id.end(); ++it) {
+        if ((uxs::is_digit(*it) || uxs::is_upper(*it)) && uxs::is_lower(*(it - 1))) { new_id.push_back('_'); }
+        new_id.push_back(uxs::to_lower(*it));
+    }
+    if (is_member) { new_id.push_back('_'); }
+    return true;
+}
 
-    Token token{TokenType::kSymbol, false, line_, pos_};
+// Recognizes long runs of whitespaces, identifiers, comments and strings without the state machine. The result is the
+// same as of the state machine for initial and at-beginning-of-line start conditions. Returns `false` for all other
+// tokens, which are left to the state machine. Note that the state machine accepts no zero characters in tokens
+bool scanToken(const char* first, const char* last, int& pat, std::size_t& llen) {
+    const char* p = first;
+    char ch = *p;
+    if (ch == ' ' || ch == '\t' || ch == '\\') {
+        while (true) {
+            p = text_scan::skipBlanks(p, last);
+            if (last - p < 2 || p[0] != '\\' || p[1] != '\n') { break; }
+            p += 2;
+        }
+        if (p == first) { return false; }
+        pat = lex_detail::pat_ws;
+    } else if ((ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || ch == '_') {
+        p = text_scan::skipIdChars(p + 1, last);
+        pat = lex_detail::pat_id;
+    } else if (ch == '/' && last - p >= 2 && p[1] == '*') {
+        p += 2;
+        while (true) {
+            p = text_scan::findFirstOf(p, last, '*', '\\', '\0');
+            if (last - p < 2 || *p == '\0') { return false; }  // unterminated comment
+            if (*p == '\\') {
+                if (p[1] == '\0') { return false; }
+                p += 2;
+                continue;
+            }
+            while (++p != last && *p == '*') {}
+            if (p == last) { return false; }
+            if (*p == '/') { break; }
+        }
+        ++p, pat = lex_detail::pat_comment;
+    } else if (ch == '/' && last - p >= 2 && p[1] == '/') {
+        p += 2;
+        while (true) {
+            p = text_scan::findFirstOf(p, last, '\n', '\\', '\0');
+            if (last - p < 2 || *p != '\\' || p[1] == '\0') { break; }
+            p += 2;
+        }
+        pat = lex_detail::pat_comment;
+    } else if (ch == '"' || ch == '\'') {
+        ++p;
+        while (true) {
+            p = text_scan::findFirstOf(p, last, ch, '\\', '\0');
+            if (p == last || *p == '\0') { return false; }  // unterminated string
+            if (*p == ch) { break; }
+            if (last - p < 2 || p[1] == '\0') { return false; }
+            p += 2;
+        }
+        ++p, pat = lex_detail::pat_string;
+    } else {
+        return false;
+    }
+    llen = static_cast<std::size_t>(p - first);
+    return true;
+}
 
-    const char* token_start = first_;
+// Lexes the next token and leading whitespaces from `first`, advances `first` and updates start condition `sc`
+Parser::TokenType lexToken(const char*& first, const char* last, int& sc, std::size_t& ws_count) {
+    const char* token_start = first;
+    auto type = Parser::TokenType::kSymbol;
 
     while (true) {
         int pat = 0;
         std::size_t llen = 0;
-        const char *first = first_, *lexeme = first;
-        while (true) {
-            const char* last = last_;
-            if (lex_state_stack_.avail() < static_cast<std::size_t>(last - first)) {
-                last = first + lex_state_stack_.avail();
-            }
-            auto* sptr = lex_state_stack_.endp();
-            pat = lex_detail::lex(first, last, &sptr, &llen, last != last_ ? lex_detail::flag_has_more : 0);
-            lex_state_stack_.setsize(sptr - lex_state_stack_.data());
-            if (pat >= lex_detail::predef_pat_default || last == last_) { break; }
-            // enlarge state stack and continue analysis
-            lex_state_stack_.reserve(llen);
-            first = last;
-        }
-        first_ += llen;
+        if (first == last || sc == lex_detail::sc_preproc || !scanToken(first, last, pat, llen)) {
+            pat = lex_detail::lexLongest(first, last, sc, llen);
+        }
+        first += llen;
         if (pat >= lex_detail::predef_pat_default) {
-            trackPosition(std::string_view{lexeme, llen});
             switch (pat) {
-                case lex_detail::pat_comment: token.type = TokenType::kComment; break;
-                case lex_detail::pat_string: token.type = TokenType::kString; break;
-                case lex_detail::pat_id: token.type = TokenType::kIdentifier; break;
-                case lex_detail::pat_int: token.type = TokenType::kInteger; break;
-                case lex_detail::pat_real: token.type = TokenType::kReal; break;
+                case lex_detail::pat_comment: type = Parser::TokenType::kComment; break;
+                case lex_detail::pat_string: type = Parser::TokenType::kString; break;
+                case lex_detail::pat_id: type = Parser::TokenType::kIdentifier; break;
+                case lex_detail::pat_int: type = Parser::TokenType::kInteger; break;
+                case lex_detail::pat_real: type = Parser::TokenType::kReal; break;
                 case lex_detail::pat_preproc_body: {
-                    token.type = TokenType::kPreprocBody;
-                    lex_state_stack_.back() = lex_detail::sc_initial;
+                    type = Parser::TokenType::kPreprocBody;
+                    sc = lex_detail::sc_initial;
                 } break;
                 case lex_detail::pat_preproc: {
-                    token.type = TokenType::kPreprocId;
-                    lex_state_stack_.back() = lex_detail::sc_preproc;
+                    type = Parser::TokenType::kPreprocId;
+                    sc = lex_detail::sc_preproc;
                 } break;
                 case lex_detail::pat_ws:
-                case lex_detail::pat_eol: token.ws_count += llen; break;
+                case lex_detail::pat_eol: ws_count += llen; break;
                 default: break;
             }
         } else {
-            token.type = TokenType::kEof;
+            type = Parser::TokenType::kEof;
         }
 
         if (pat == lex_detail::pat_eol) {
-            lex_state_stack_.back() = lex_detail::sc_at_beg_of_line;
+            sc = lex_detail::sc_at_beg_of_line;
         } else if (pat != lex_detail::pat_ws) {
-            if (pat != lex_detail::pat_preproc) { lex_state_stack_.back() = lex_detail::sc_initial; }
-            token.text = std::string_view{token_start, static_cast<std::size_t>(first_ - token_start)};
-            if (token.type == TokenType::kPreprocBody) { token.ws_count = countWs(token.text); }
-            if (token.type != TokenType::kComment) {
-                token.is_first_significant = is_first_significant_token_;
-                is_first_significant_token_ = false;
+            if (pat != lex_detail::pat_preproc) { sc = lex_detail::sc_initial; }
+            if (type == Parser::TokenType::kPreprocBody) {
+                ws_count = countWs(std::string_view{token_start, static_cast<std::size_t>(first - token_start)});
             }
             break;
         }
     }
+    return type;
+}
+
+// Start condition after a token: only a preprocessor directive name is followed by its body
+int getScAfter(Parser::TokenType type) {
+    return type == Parser::TokenType::kPreprocId ? lex_detail::sc_preproc : lex_detail::sc_initial;
+}
+}  // namespace
+
+Parser::Parser(std::string_view file_name, TokenBuffer& tokens, TextProcFlags flags)
+    : file_name_(file_name), flags_(flags), tokens_(&tokens), text_(tokens.getText().data()),
+      lookahead_(kInitialLookaheadSize, tokens.getResource()), fixed_texts_(tokens.getResource()),
+      fixed_body_tokens_(tokens.getResource()), line_offsets_(1, 0, tokens.getResource()),
+      pos_shifts_(tokens.getResource()) {}
+
+std::size_t Parser::findMatch(std::size_t index) { return tokens_->findMatch(index); }
+
+TokenBuffer& Parser::getBodyTokens(std::size_t n) {
+    const auto& token = peek(n);
+    if (!(token.flags & Token::kFixedText)) { return tokens_->getBodyTokens(getIndex(n)); }
+    return fixed_body_tokens_.emplace_back(token.getText(), TextProcFlags::kNone, tokens_->getResource());
+}
+
+void Parser::lookAhead(std::size_t n) {
+    if (n >= lookahead_.size()) {
+        std::size_t size = lookahead_.size();
+        while (n >= size) { size *= 2; }
+        std::pmr::vector<Token> lookahead(size, lookahead_.get_allocator());
+        for (std::size_t i = 0; i != lookahead_count_; ++i) {
+            lookahead[i] = lookahead_[(lookahead_pos_ + i) & (lookahead_.size() - 1)];
+        }
+        lookahead_.swap(lookahead);
+        lookahead_pos_ = 0;
+    }
+    for (; lookahead_count_ <= n; ++lookahead_count_) {
+        lookahead_[(lookahead_pos_ + lookahead_count_) & (lookahead_.size() - 1)] = readNext();
+    }
+}
 
+Parser::Token Parser::makeToken(std::size_t index) const {
+    Token token{text_ + tokens_->getOffset(index), 0, 0, tokens_->getType(index)};
+    token.setText(std::string_view{token.first, tokens_->getLength(index)}, tokens_->getWsCount(index));
+    if (!tokens_->isInFixRange(tokens_->getOffset(index) + tokens_->getWsCount(index))) {
+        token.flags |= Token::kOutOfFixRange;
+    }
     return token;
 }
 
+Parser::Token Parser::readNext() {
+    if (!tokens_->fetch(pos_)) {  // past the end of file token
+        ++pos_;
+        return Token{text_ + tokens_->getText().size(), 0, 0, TokenType::kEof};
+    }
+
+    Token token = makeToken(pos_);
+    if (pos_++ == 0) { token.flags |= Token::kFirst; }
+    if (token.type != TokenType::kComment) {
+        if (is_first_significant_token_) { token.flags |= Token::kFirstSignificant; }
+        is_first_significant_token_ = false;
+    }
+
+    if (!!(flags_ & TextProcFlags::kFixIdNaming)) {
+        if (token.type == TokenType::kIdentifier && token.isInFixRange()) {
+            fixIdNaming(token);
+        } else if (token.type == TokenType::kPreprocBody && is_define_ && token.isInFixRange()) {
+            fixDefineBody(token);
+        }
+        is_define_ = token.isPreprocIdentifier("define");
+    }
+    return token;
+}
+
+void Parser::fixIdNaming(Token& token) {
+    // Function names are kept, so the next token is needed to decide; an identifier is never the last token
+    tokens_->fetch(pos_);
+    Token next = makeToken(pos_);
+
+    auto id = token.getTrimmedText();
+    if (next.isSymbol('(')) {
+        if (id[0] == '_') { printWarning("{}:{}: underscored function name {}", file_name_, getLine(token), id); }
+        return;
+    }
+
+    std::size_t ws_count = token.getWsCount();
+    std::pmr::string fixed_text{token.getText().substr(0, ws_count), tokens_->getResource()};
+    if (!makeFixedIdName(id, fixed_text)) { return; }
+    countStat(RunStats::Counter::kIdsRenamed);
+
+    // Positions are given as if the text was already fixed
+    pos_shifts_.emplace_back(getOffset(next), static_cast<unsigned>(fixed_text.size() - token.size));
+
+    token.setText(fixed_texts_.emplace_back(std::move(fixed_text)), ws_count);
+    token.flags |= Token::kFixedText;
+}
+
+void Parser::fixDefineBody(Token& token) {
+    Parser parser("", tokens_->getBodyTokens(pos_ - 1), TextProcFlags::kFixIdNaming);
+    std::pmr::string fixed_text(tokens_->getResource());
+    Token body_token;
+    do {
+        body_token = parser.parseNext();
+        fixed_text.append(body_token.getText());
+    } while (!body_token.isEof());
+    if (fixed_text == token.getText()) { return; }
+
+    auto calc_last_line_length = [](std::string_view s) { return s.size() - s.rfind('\n') - 1; };
+    pos_shifts_.emplace_back(getOffset(token) + token.size, static_cast<unsigned>(calc_last_line_length(fixed_text) -
+                                                                              calc_last_line_length(token.getText())));
+
+    token.setText(fixed_texts_.emplace_back(std::move(fixed_text)), token.getWsCount());
+    token.flags |= Token::kFixedText;
+}
+
+unsigned Parser::getLine(std::size_t offset) {
+    for (const char* p = text_ + indexed_offset_; p < text_ + offset; ++p) {
+        p = text_scan::findFirstOf(p, text_ + offset, '\n');
+        if (p == text_ + offset) { break; }
+        line_offsets_.push_back(static_cast<std::size_t>(p + 1 - text_));
+    }
+    indexed_offset_ = std::max(indexed_offset_, offset);
+    return static_cast<unsigned>(std::upper_bound(line_offsets_.begin(), line_offsets_.end(), offset) -
+                                 line_offsets_.begin());
+}
+
+unsigned Parser::getPos(std::size_t offset) {
+    std::size_t line_offset = line_offsets_[getLine(offset) - 1];
+    auto pos = static_cast<unsigned>(1 + offset - line_offset);
+    auto it = std::lower_bound(pos_shifts_.begin(), pos_shifts_.end(), std::make_pair(line_offset, 0U));
+    for (; it != pos_shifts_.end() && it->first <= offset; ++it) { pos += it->second; }
+    return pos;
+}
+
 std::string_view Parser::Token::getPreprocIdentifier() const {
+    auto text = getText();
     return std::string_view(
-        std::find_if(text.begin() + ws_count, text.end(), [](char ch) { return uxs::is_alpha(ch) || ch == '_'; }),
+        std::find_if(text.begin() + getWsCount(), text.end(), [](char ch) { return uxs::is_alpha(ch) || ch == '_'; }),
         text.end());
 }
 
 std::string_view Parser::Token::getFirstIdentifier() const {
-    auto first = text.begin() + ws_count;
+    auto text = getText();
+    auto first = text.begin() + getWsCount();
     if (first == text.end() || (!uxs::is_alpha(*first) && *first != '_')) { return {}; }
     auto last = std::find_if(first + 1, text.end(), [](char ch) { return !uxs::is_alnum(ch) && ch != '_'; });
     return std::string_view(first, last);
 }
+
+std::size_t Parser::Token::calcLongWsCount() const {
+    auto text = getText();
+    if (type == TokenType::kPreprocBody) { return countWs(text); }
+    std::size_t count = 0;
+    for (; count != text.size(); ++count) {
+        if (text[count] == '\\' && count + 1 != text.size() && text[count + 1] == '\n') {
+            ++count;
+        } else if (text[count] != ' ' && text[count] != '\t' && text[count] != '\n') {
+            break;
+        }
+    }
+    return count;
+}
+
+TokenBuffer& TokenBuffer::getBodyTokens(std::size_t n) {
+    auto& body_tokens = body_token_index_[n];
+    if (!body_tokens) {
+        body_tokens = &body_tokens_.emplace_back(std::span{text_ + offsets_[n], getLength(n)}, TextProcFlags::kNone,
+                                                 getResource());
+        if (is_restricted_) {  // the ranges are shifted to the body
+            std::size_t first = offsets_[n], last = offsets_[n + 1];
+            body_tokens->is_restricted_ = true;
+            for (const auto& range : fix_ranges_) {
+                if (range.first < last && range.second > first) {
+                    body_tokens->fix_ranges_.emplace_back(std::max(range.first, first) - first,
+                                                          std::min(range.second, last) - first);
+                }
+            }
+        }
+    }
+    return *body_tokens;
+}
+
+void TokenBuffer::setFixRanges(std::span<const std::pair<unsigned, unsigned>> line_ranges) {
+    std::vector<std::pair<unsigned, unsigned>> sorted_ranges(line_ranges.begin(), line_ranges.end());
+    std::sort(sorted_ranges.begin(), sorted_ranges.end());
+
+    const char* p = text_;
+    unsigned ln = 1;
+    auto skip_to_line = [this, &p, &ln](unsigned n) {
+        while (ln < n && (p = text_scan::findFirstOf(p, last_, '\n')) != last_) { ++p, ++ln; }
+    };
+
+    is_restricted_ = true;
+    fix_ranges_.clear();
+    for (const auto& [first_ln, last_ln] : sorted_ranges) {
+        skip_to_line(first_ln);
+        if (ln < first_ln) { break; }
+        auto first = static_cast<std::size_t>(p - text_);
+        skip_to_line(last_ln + 1);
+        auto last = static_cast<std::size_t>(p - text_) + (p == last_ ? 1 : 0);  // the end of file is in the last line
+        if (!fix_ranges_.empty() && first <= fix_ranges_.back().second) {
+            fix_ranges_.back().second = std::max(fix_ranges_.back().second, last);
+        } else {
+            fix_ranges_.emplace_back(first, last);
+        }
+    }
+}
+
+void TokenBuffer::lexNext() {
+    std::size_t ws_count = 0;
+    auto type = lexToken(first_, last_, lex_sc_, ws_count);
+    pushToken(type, static_cast<std::size_t>(first_ - text_), ws_count);
+}
+
+void TokenBuffer::pushToken(Parser::TokenType type, std::size_t end_offset, std::size_t ws_count) {
+    const char* token_start = text_ + offsets_.back();
+    std::size_t n = types_.size();
+    types_.push_back(type);
+    offsets_.push_back(static_cast<std::uint32_t>(end_offset));
+    ws_counts_.push_back(static_cast<std::uint32_t>(ws_count));
+    matches_.push_back(kNoMatch);
+
+    auto pair_with_open = [this, n](std::pmr::vector<std::uint32_t>& open) {
+        if (open.empty()) { return; }
+        matches_[open.back()] = static_cast<std::uint32_t>(n), matches_[n] = open.back();
+        open.pop_back();
+    };
+
+    if (type == Parser::TokenType::kSymbol) {
+        switch (token_start[ws_count]) {
+            case '(': open_parens_.push_back(static_cast<std::uint32_t>(n)); break;
+            case ')': pair_with_open(open_parens_); break;
+            case '{': open_braces_.push_back(static_cast<std::uint32_t>(n)); break;
+            case '}': pair_with_open(open_braces_); break;
+            default: break;
+        }
+    } else if (type == Parser::TokenType::kEof) {
+        is_complete_ = true;
+    }
+}
+
+void TokenBuffer::lexAll(unsigned thread_count) {
+    const std::size_t size = static_cast<std::size_t>(last_ - first_);
+    const std::size_t chunk_count = std::min<std::size_t>(thread_count, size / kMinLexChunkSize);
+    if (chunk_count <= 1 || is_complete_) {
+        while (!is_complete_) { lexNext(); }
+        return;
+    }
+
+    // Chunks begin at line beginnings, where lexing is started speculatively as if no token crossed the boundary
+    std::vector<const char*> bounds{first_};
+    for (std::size_t n = 1; n != chunk_count; ++n) {
+        const char* p = text_scan::findFirstOf(std::max(first_ + n * size / chunk_count, bounds.back()), last_, '\n');
+        if (p == last_) { break; }
+        bounds.push_back(p + 1);
+    }
+    bounds.push_back(last_);
+
+    std::vector<LexedChunk> chunks(bounds.size() - 1);
+    {
+        std::vector<std::thread> threads;
+        threads.reserve(chunks.size() - 1);
+        for (std::size_t n = 1; n != chunks.size(); ++n) {
+            threads.emplace_back([this, &bounds, &chunk = chunks[n], n] {
+                lexChunk(bounds[n], bounds[n + 1], lex_detail::sc_at_beg_of_line, chunk);
+            });
+        }
+        lexChunk(bounds[0], bounds[1], lex_sc_, chunks[0]);  // the first chunk starts in the actual state
+        for (auto& thread : threads) { thread.join(); }
+    }
+
+    std::size_t token_count = types_.size();
+    for (const auto& chunk : chunks) { token_count += chunk.types.size(); }
+    types_.reserve(token_count), offsets_.reserve(token_count + 1), ws_counts_.reserve(token_count);
+    matches_.reserve(token_count);
+
+    // Tokens of a chunk are taken from the first one which ends where the taken tokens end and leaves the same start
+    // condition: from there both lexers are in the same state. Until such a token is found, e.g. if a comment or a
+    // string crosses the chunk boundary, tokens are lexed again sequentially
+    appendChunk(chunks[0], 0);
+    for (std::size_t n = 1; n != chunks.size() && !is_complete_; ++n) {
+        const auto& chunk = chunks[n];
+        while (!is_complete_) {
+            const std::uint32_t end_offset = offsets_.back();
+            auto it = std::lower_bound(chunk.end_offsets.begin(), chunk.end_offsets.end(), end_offset);
+            if (it != chunk.end_offsets.end() && *it == end_offset &&
+                getScAfter(chunk.types[it - chunk.end_offsets.begin()]) == getScAfter(types_.back())) {
+                appendChunk(chunk, static_cast<std::size_t>(it - chunk.end_offsets.begin()) + 1);
+                break;
+            }
+            if (chunk.end_offsets.empty() || end_offset >= chunk.end_offsets.back()) { break; }  // chunk is passed
+            lexNext();
+        }
+    }
+    while (!is_complete_) { lexNext(); }
+}
+
+void TokenBuffer::lexChunk(const char* first, const char* stop, int sc, LexedChunk& chunk) const {
+    Parser::TokenType type = Parser::TokenType::kEof;
+    do {
+        std::size_t ws_count = 0;
+        type = lexToken(first, last_, sc, ws_count);
+        chunk.types.push_back(type);
+        chunk.end_offsets.push_back(static_cast<std::uint32_t>(first - text_));
+        chunk.ws_counts.push_back(static_cast<std::uint32_t>(ws_count));
+    } while (first < stop && type != Parser::TokenType::kEof);
+}
+
+void TokenBuffer::appendChunk(const LexedChunk& chunk, std::size_t first_index) {
+    for (std::size_t n = first_index; n != chunk.types.size(); ++n) {
+        pushToken(chunk.types[n], chunk.end_offsets[n], chunk.ws_counts[n]);
+    }
+    first_ = text_ + offsets_.back();
+    lex_sc_ = getScAfter(types_.back());
+}
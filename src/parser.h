@@ -3,19 +3,30 @@
 #include <uxs/algorithm.h>
 #include <uxs/string_cvt.h>
 
+#include <algorithm>
+#include <cstdint>
+#include <deque>
+#include <list>
+#include <memory_resource>
 #include <span>
+#include <string>
+#include <unordered_map>
 #include <vector>
 
 namespace lex_detail {
 #include "lex_defs.h"
 }
 
-enum class TextProcFlags { kNone = 0, kAtBegOfLine = 1 };
+enum class TextProcFlags { kNone = 0, kAtBegOfLine = 1, kFixIdNaming = 2 };
 UXS_IMPLEMENT_BITWISE_OPS_FOR_ENUM(TextProcFlags);
 
+class TokenBuffer;
+
+// Reads tokens of a token buffer, fixing identifier naming if requested; transient data is allocated from the memory
+// resource of the token buffer
 class Parser {
  public:
-    enum class TokenType {
+    enum class TokenType : std::uint8_t {
         kEof = 0,
         kSymbol,
         kIdentifier,
@@ -27,16 +38,24 @@ class Parser {
         kComment,
     };
 
+    // Token text is leading whitespaces followed by the lexeme; it points to the parsed text or to a fixed text
     struct Token {
+        enum : std::uint8_t { kFirst = 1, kFirstSignificant = 2, kFixedText = 4, kOutOfFixRange = 8 };
+        static constexpr std::uint16_t kLongWsCount = 0xffff;  // the count doesn't fit and is calculated on demand
+
+        const char* first = nullptr;
+        std::uint32_t size = 0;
+        std::uint16_t ws_count = 0;
         TokenType type = TokenType::kEof;
-        bool is_first_significant = false;
-        unsigned line = 0, pos = 0;
-        std::size_t ws_count = 0;
-        std::string_view text;
-        bool isFirst() const { return line == 1 && pos == 1; }
-        bool isFirstSignificant() const { return is_first_significant; }
+        std::uint8_t flags = 0;
+
+        std::string_view getText() const { return std::string_view{first, size}; }
+        std::size_t getWsCount() const { return ws_count != kLongWsCount ? ws_count : calcLongWsCount(); }
+        bool isFirst() const { return flags & kFirst; }
+        bool isFirstSignificant() const { return flags & kFirstSignificant; }
+        bool isInFixRange() const { return !(flags & kOutOfFixRange); }
         bool isEof() const { return type == TokenType::kEof; }
-        bool isSymbol(char ch) const { return type == TokenType::kSymbol && text[ws_count] == ch; }
+        bool isSymbol(char ch) const { return type == TokenType::kSymbol && first[getWsCount()] == ch; }
         bool isComment() const { return type == TokenType::kComment; }
         bool isIdentifier(std::string_view id) const {
             return type == TokenType::kIdentifier && getTrimmedText() == id;
@@ -53,60 +72,174 @@ class Parser {
         }
         std::string_view getPreprocIdentifier() const;
         std::string_view getFirstIdentifier() const;
-        int trackLevel(int level, char ch_open, char ch_close) const {
-            if (type == TokenType::kSymbol) {
-                if (text[ws_count] == ch_open) {
-                    ++level;
-                } else if (text[ws_count] == ch_close) {
-                    --level;
-                }
-            }
-            return level;
-        }
-        std::string_view getTrimmedText() const { return text.substr(ws_count); }
-        bool hasNewLine() const { return text.substr(0, ws_count).find('\n') != std::string::npos; }
-        std::string makeIndented(std::string_view text) const {
-            std::string result = '\n' + std::string(std::max<std::size_t>(1, pos) - 1, ' ');
-            return result += text;
-        }
-
+        std::string_view getTrimmedText() const { return getText().substr(getWsCount()); }
+        bool hasNewLine() const { return getText().substr(0, getWsCount()).find('\n') != std::string::npos; }
         std::string_view getEmptyLines() const {
-            auto nl_pos = text.substr(0, ws_count).rfind('\n');
+            auto text = getText();
+            auto nl_pos = text.substr(0, getWsCount()).rfind('\n');
             return nl_pos != std::string::npos ? text.substr(0, nl_pos) : std::string_view{};
         }
 
+        void setText(std::string_view text, std::size_t ws) {
+            first = text.data(), size = static_cast<std::uint32_t>(text.size());
+            ws_count = static_cast<std::uint16_t>(std::min<std::size_t>(ws, kLongWsCount));
+        }
         void trimEmptyLines() {
-            auto nl_pos = text.substr(0, ws_count).rfind('\n');
-            if (nl_pos != std::string::npos) { text = text.substr(nl_pos + 1), ws_count -= nl_pos + 1; }
+            auto text = getText();
+            std::size_t ws = getWsCount();
+            auto nl_pos = text.substr(0, ws).rfind('\n');
+            if (nl_pos != std::string::npos) { setText(text.substr(nl_pos + 1), ws - nl_pos - 1); }
         }
+
+     private:
+        std::size_t calcLongWsCount() const;
     };
 
-    Parser(std::string file_name, std::span<const char> text, TextProcFlags flags = TextProcFlags::kAtBegOfLine)
-        : file_name_(std::move(file_name)) {
-        first_ = text.data(), last_ = text.data() + text.size();
-        revert_stack_.reserve(16);
-        lex_state_stack_.reserve(256);
-        lex_state_stack_.push_back(!!(flags & TextProcFlags::kAtBegOfLine) ? lex_detail::sc_at_beg_of_line :
-                                                                             lex_detail::sc_initial);
+    Parser(std::string_view file_name, TokenBuffer& tokens, TextProcFlags flags = TextProcFlags::kNone);
+    std::string_view getFileName() const { return file_name_; }
+    std::size_t getOffset(const Token& token) const { return static_cast<std::size_t>(token.first - text_); }
+    unsigned getLine(const Token& token) { return getLine(getOffset(token) + token.getWsCount()); }
+    unsigned getLine(std::size_t offset);
+    unsigned getPos(std::size_t offset);
+    std::pmr::string makeIndented(const Token& token, std::string_view text) {
+        std::pmr::string result(getPos(getOffset(token)), ' ', lookahead_.get_allocator());
+        result[0] = '\n';
+        return result += text;
     }
-    const std::string& getFileName() const { return file_name_; }
-    unsigned getLn() const { return line_; }
-    Token parseNext();
-    void revert(Token token) { revert_stack_.emplace_back(token); }
+
+    // Returns `n`-th token ahead without consuming it; the reference is valid until the next `peek` or `parseNext`
+    Token& peek(std::size_t n = 0) {
+        if (n >= lookahead_count_) { lookAhead(n); }
+        return lookahead_[(lookahead_pos_ + n) & (lookahead_.size() - 1)];
+    }
+    // Consumes the token returned by `peek()`
+    void advance() { lookahead_pos_ = (lookahead_pos_ + 1) & (lookahead_.size() - 1), --lookahead_count_; }
+    Token parseNext() {
+        Token token = peek();
+        advance();
+        return token;
+    }
+    // Returns the index in the token buffer of `n`-th token ahead
+    std::size_t getIndex(std::size_t n = 0) {
+        peek(n);
+        return pos_ - lookahead_count_ + n;
+    }
+    std::size_t findMatch(std::size_t index);
+    // Returns the tokens of `#define` body which is `n`-th token ahead
+    TokenBuffer& getBodyTokens(std::size_t n = 0);
 
  private:
-    std::string file_name_;
+    std::string_view file_name_;
+    TextProcFlags flags_;
+    TokenBuffer* tokens_;
+    const char* text_;
+    std::size_t pos_ = 0;  // index of the next token to read from `tokens_`
     bool is_first_significant_token_ = true;
-    unsigned line_ = 1, pos_ = 1;
-    const char* first_ = nullptr;
-    const char* last_ = nullptr;
-    uxs::inline_basic_dynbuffer<int, 1> lex_state_stack_;
-    std::vector<Token> revert_stack_;
-
-    void trackPosition(std::string_view s) {
-        uxs::for_each(s, [this](char ch) {
-            if (ch == '\n') { ++line_, pos_ = 0; }
-            ++pos_;
-        });
+    bool is_define_ = false;
+    std::pmr::vector<Token> lookahead_;  // ring buffer of processed tokens, its size is a power of 2
+    std::size_t lookahead_pos_ = 0;
+    std::size_t lookahead_count_ = 0;
+    std::pmr::deque<std::pmr::string> fixed_texts_;
+    std::pmr::list<TokenBuffer> fixed_body_tokens_;
+    std::pmr::vector<std::size_t> line_offsets_;  // built lazily up to `indexed_offset_`
+    std::size_t indexed_offset_ = 0;
+    std::pmr::vector<std::pair<std::size_t, unsigned>> pos_shifts_;  // (offset, delta) made by fixed names
+
+    static constexpr std::size_t kInitialLookaheadSize = 8;
+
+    void lookAhead(std::size_t n);
+    Token makeToken(std::size_t index) const;
+    Token readNext();
+    void fixIdNaming(Token& token);
+    void fixDefineBody(Token& token);
+};
+
+static_assert(sizeof(Parser::Token) <= 16);
+
+// Tokens of a text stored in parallel arrays. The text is lexed on demand and only once, so that all passes over the
+// text share its tokens. Pairs of `()` and `{}` are matched while lexing, tokens of `#define` bodies are lexed into
+// nested buffers. All arrays, nested buffers included, are allocated from the given memory resource.
+class TokenBuffer {
+ public:
+    // Offsets and token indices are 32-bit: a text must be shorter than `kNoMatch` bytes, so it has fewer tokens, its
+    // offsets don't wrap and `kNoMatch` is never a valid index; longer texts are rejected by callers
+    static constexpr std::size_t kNoMatch = 0xffffffff;
+    static constexpr std::size_t kMaxTextSize = kNoMatch - 1;
+
+    explicit TokenBuffer(std::span<const char> text, TextProcFlags flags = TextProcFlags::kAtBegOfLine,
+                         std::pmr::memory_resource* resource = std::pmr::get_default_resource())
+        : text_(text.data()), first_(text.data()), last_(text.data() + text.size()),
+          lex_sc_(!!(flags & TextProcFlags::kAtBegOfLine) ? lex_detail::sc_at_beg_of_line : lex_detail::sc_initial),
+          types_(resource), offsets_(1, 0, resource), ws_counts_(resource), matches_(resource), open_parens_(resource),
+          open_braces_(resource), body_tokens_(resource), body_token_index_(resource), fix_ranges_(resource) {}
+    TokenBuffer(const TokenBuffer&) = delete;
+    TokenBuffer& operator=(const TokenBuffer&) = delete;
+
+    std::pmr::memory_resource* getResource() const { return types_.get_allocator().resource(); }
+    std::span<const char> getText() const { return std::span{text_, last_}; }
+
+    // Restricts fixes to the given line ranges `[first, last]`; the end of file is in range if the last line is
+    void setFixRanges(std::span<const std::pair<unsigned, unsigned>> line_ranges);
+    bool isInFixRange(std::size_t offset) const {
+        if (!is_restricted_) { return true; }
+        auto it = std::upper_bound(fix_ranges_.begin(), fix_ranges_.end(), offset,
+                                   [](std::size_t offset, const auto& range) { return offset < range.second; });
+        return it != fix_ranges_.end() && it->first <= offset;
+    }
+    std::size_t getTokenCount() const { return types_.size(); }  // of lexed tokens
+
+    // Lexes the text up to token `n`; returns `false` if `n` is past the end of file token
+    bool fetch(std::size_t n) {
+        while (n >= types_.size()) {
+            if (is_complete_) { return false; }
+            lexNext();
+        }
+        return true;
     }
+    Parser::TokenType getType(std::size_t n) const { return types_[n]; }
+    std::size_t getOffset(std::size_t n) const { return offsets_[n]; }
+    std::size_t getLength(std::size_t n) const { return offsets_[n + 1] - offsets_[n]; }
+    std::size_t getWsCount(std::size_t n) const { return ws_counts_[n]; }
+    // Returns the index of the bracket paired with opening bracket `n` or `kNoMatch`
+    std::size_t findMatch(std::size_t n) {
+        if (!fetch(n)) { return kNoMatch; }
+        while (matches_[n] == kNoMatch && !is_complete_) { lexNext(); }
+        return matches_[n];
+    }
+    TokenBuffer& getBodyTokens(std::size_t n);
+
+    // Lexes the rest of the text at once; a large text is split at line beginnings into chunks, which are lexed in
+    // parallel by up to `thread_count` threads, then seams between chunks are checked and relexed where needed
+    void lexAll(unsigned thread_count);
+
+ private:
+    static constexpr std::size_t kMinLexChunkSize = 256 * 1024;
+
+    // Tokens of a chunk lexed by a worker thread, so they are allocated from the heap
+    struct LexedChunk {
+        std::vector<Parser::TokenType> types;
+        std::vector<std::uint32_t> end_offsets;
+        std::vector<std::uint32_t> ws_counts;
+    };
+
+    const char* text_;
+    const char* first_;
+    const char* last_;
+    int lex_sc_;
+    bool is_complete_ = false;
+    bool is_restricted_ = false;
+    std::pmr::vector<Parser::TokenType> types_;
+    std::pmr::vector<std::uint32_t> offsets_;  // one more than tokens, the last one is the end of lexed text
+    std::pmr::vector<std::uint32_t> ws_counts_;
+    std::pmr::vector<std::uint32_t> matches_;
+    std::pmr::vector<std::uint32_t> open_parens_;
+    std::pmr::vector<std::uint32_t> open_braces_;
+    std::pmr::list<TokenBuffer> body_tokens_;
+    std::pmr::unordered_map<std::size_t, TokenBuffer*> body_token_index_;
+    std::pmr::vector<std::pair<std::size_t, std::size_t>> fix_ranges_;  // sorted disjoint offset ranges `[first, last)`
+
+    void lexNext();
+    void pushToken(Parser::TokenType type, std::size_t end_offset, std::size_t ws_count);
+    void lexChunk(const char* first, const char* stop, int sc, LexedChunk& chunk) const;
+    void appendChunk(const LexedChunk& chunk, std::size_t first_index);
 };
@@ -3,20 +3,48 @@
 #include <uxs/format.h>
 #include <uxs/format_fs.h>  // NOLINT
 
+#include <vector>
+
 extern unsigned g_debug_level;
 
+// Messages of a file being processed by a worker thread are collected here and flushed in input order
+struct MessageLog {
+    std::vector<std::pair<bool, std::string>> messages;  // (is error, text)
+    void flush() {
+        for (const auto& [is_error, msg] : messages) {
+            (is_error ? uxs::stdbuf::err() : uxs::stdbuf::out()).write(msg).endl();
+        }
+        messages.clear();
+    }
+};
+
+extern thread_local MessageLog* g_message_log;
+
+inline void printMessage(bool is_error, std::string msg) {
+    if (g_message_log) {
+        g_message_log->messages.emplace_back(is_error, std::move(msg));
+    } else {
+        (is_error ? uxs::stdbuf::err() : uxs::stdbuf::out()).write(msg).endl();
+    }
+}
+
+template<typename... Args>
+void printInfo(uxs::format_string<Args...> fmt, const Args&... args) {
+    printMessage(false, uxs::vformat(fmt.get(), uxs::make_format_args(args...)));
+}
+
 template<typename... Args>
 void printError(uxs::format_string<Args...> fmt, const Args&... args) {
     std::string msg("\033[1;37mcode-format: \033[0;31merror: \033[0m");
     msg += fmt.get();
-    uxs::vprint(uxs::stdbuf::err(), msg, uxs::make_format_args(args...)).endl();
+    printMessage(true, uxs::vformat(msg, uxs::make_format_args(args...)));
 }
 
 template<typename... Args>
 void printWarning(uxs::format_string<Args...> fmt, const Args&... args) {
     std::string msg("\033[1;37mcode-format: \033[0;35mwarning: \033[0m");
     msg += fmt.get();
-    uxs::vprint(uxs::stdbuf::out(), msg, uxs::make_format_args(args...)).endl();
+    printMessage(false, uxs::vformat(msg, uxs::make_format_args(args...)));
 }
 
 template<typename... Args>
@@ -24,5 +52,5 @@ void printDebug(unsigned level, uxs::format_string<Args...> fmt, const Args&...
     if (g_debug_level < level) { return; }
     std::string msg("\033[1;37mcode-format: \033[0;33mdebug: \033[0m");
     msg += fmt.get();
-    uxs::vprint(uxs::stdbuf::out(), msg, uxs::make_format_args(args...)).endl();
+    printMessage(false, uxs::vformat(msg, uxs::make_format_args(args...)));
 }
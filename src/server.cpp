@@ -0,0 +1,208 @@
+#include "server.h"
+
+#include "print.h"
+#include "thread_pool.h"
+
+#include <chrono>
+
+#if !defined(_WIN32)
+#    include <sys/socket.h>
+#    include <sys/stat.h>
+#    include <sys/un.h>
+#    include <unistd.h>
+
+#    include <cerrno>
+#    include <csignal>
+#    include <cstring>
+#endif
+
+namespace {
+
+#if !defined(_WIN32)
+
+// Only a socket may be removed from the socket path, e.g. the one left by a previous instance; if `bound_st` is given,
+// it must also be the same socket
+bool removeSocket(const std::string& socket_path, const struct stat* bound_st = nullptr) {
+    struct stat st{};
+    if (::lstat(socket_path.c_str(), &st) != 0) { return errno == ENOENT; }
+    if (!S_ISSOCK(st.st_mode) || (bound_st && (st.st_dev != bound_st->st_dev || st.st_ino != bound_st->st_ino))) {
+        return false;
+    }
+    return ::unlink(socket_path.c_str()) == 0;
+}
+
+bool parseRequest(std::string_view data, ServerRequest& request) {
+    std::vector<std::string_view> args;
+    while (true) {
+        auto nl_pos = data.find('\n');
+        if (nl_pos == std::string_view::npos) {
+            printError("unterminated request argument list");
+            return false;
+        }
+        auto arg = data.substr(0, nl_pos);
+        data.remove_prefix(nl_pos + 1);
+        if (arg.empty()) { break; }
+        args.push_back(arg);
+    }
+
+    auto& params = request.params;
+    bool has_text = false;
+    for (std::size_t n = 0; n != args.size(); ++n) {
+        auto arg = args[n];
+        if (arg == "--fix-file-ending") {
+            params.fix_file_ending = true;
+        } else if (arg == "--fix-single-statement") {
+            params.fix_single_statement = true;
+        } else if (arg == "--fix-id-naming") {
+            params.fix_id_naming = true;
+        } else if (arg == "--fix-pragma-once") {
+            params.fix_pragma_once = true;
+        } else if (arg == "--remove-already-included") {
+            params.remove_already_included = true;
+        } else if (arg == "--check") {
+            params.check_only = true;
+        } else if (arg == "--text") {
+            has_text = true;
+        } else if (arg == "-D" || arg == "-I" || arg == "-IS" || arg == "--lines") {
+            if (++n == args.size()) {
+                printError("expected request argument after `{}`", arg);
+                return false;
+            }
+            auto value = args[n];
+            if (arg == "-D") {
+                params.definitions.emplace_back(value);
+            } else if (arg == "--lines") {
+                if (!parseLineRange(value, request.line_ranges.emplace_back())) {
+                    printError("invalid line range `{}`", value);
+                    return false;
+                }
+            } else {
+                params.include_dirs.emplace_back(value,
+                                                 arg == "-I" ? IncludePathType::kCustom : IncludePathType::kSystem);
+            }
+        } else if (arg.starts_with('-')) {
+            printError("unknown request option `{}`", arg);
+            return false;
+        } else if (request.file_name.empty()) {
+            request.file_name = arg;
+        } else {
+            printError("only one file can be specified in a request");
+            return false;
+        }
+    }
+
+    if (request.file_name.empty()) {
+        printError("no file specified in the request");
+        return false;
+    }
+    if (has_text) { request.text.emplace(data); }
+    return true;
+}
+
+bool readAll(int fd, std::string& data) {
+    constexpr std::size_t kReadChunkSize = 65536;
+    std::size_t size = 0;
+    while (true) {
+        if (data.size() - size < kReadChunkSize) { data.resize(size + kReadChunkSize); }
+        ssize_t n_read = ::read(fd, data.data() + size, data.size() - size);
+        if (n_read < 0 && errno == EINTR) { continue; }
+        if (n_read < 0) { return false; }
+        if (n_read == 0) { break; }
+        size += static_cast<std::size_t>(n_read);
+    }
+    data.resize(size);
+    return true;
+}
+
+bool writeAll(int fd, std::string_view data) {
+    while (!data.empty()) {
+        ssize_t n_written = ::write(fd, data.data(), data.size());
+        if (n_written < 0 && errno == EINTR) { continue; }
+        if (n_written < 0) { return false; }
+        data.remove_prefix(static_cast<std::size_t>(n_written));
+    }
+    return true;
+}
+
+void handleConnection(int fd, const ServerRequestHandler& handler) {
+    std::string data;
+    if (!readAll(fd, data)) { return; }
+
+    auto start_time = std::chrono::steady_clock::now();
+    MessageLog log;
+    g_message_log = &log;
+    ServerRequest request;
+    std::string fixed_text;
+    bool success = parseRequest(data, request) && handler(request, fixed_text);
+    printDebug(1, "-------------- request handled in {} us",
+               std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time)
+                   .count());
+    g_message_log = nullptr;
+
+    std::string messages;
+    for (const auto& [is_error, msg] : log.messages) { (messages += msg) += '\n'; }
+    writeAll(fd, uxs::format("{} {} {}\n", success ? 0 : 1, messages.size(), fixed_text.size())) &&
+        writeAll(fd, messages) && writeAll(fd, fixed_text);
+}
+
+#endif  // !defined(_WIN32)
+
+}  // namespace
+
+bool serve(const std::string& socket_path, unsigned job_count, const ServerRequestHandler& handler) {
+#if defined(_WIN32)
+    (void)socket_path, (void)job_count, (void)handler;
+    printError("server mode is not supported on this platform");
+    return false;
+#else
+    sockaddr_un addr{};
+    if (socket_path.size() >= sizeof(addr.sun_path)) {
+        printError("socket path `{}` is too long", socket_path);
+        return false;
+    }
+    addr.sun_family = AF_UNIX;
+    std::memcpy(addr.sun_path, socket_path.c_str(), socket_path.size() + 1);
+
+    int listen_fd = ::socket(AF_UNIX, SOCK_STREAM, 0);
+    if (listen_fd < 0) {
+        printError("could not create socket: {}", std::strerror(errno));
+        return false;
+    }
+
+    if (!removeSocket(socket_path)) {
+        printError("could not use `{}` as socket path: the file exists and is not a socket", socket_path);
+        ::close(listen_fd);
+        return false;
+    }
+    if (::bind(listen_fd, reinterpret_cast<const sockaddr*>(&addr), sizeof(addr)) != 0 ||
+        ::listen(listen_fd, SOMAXCONN) != 0) {
+        printError("could not listen on socket `{}`: {}", socket_path, std::strerror(errno));
+        ::close(listen_fd);
+        return false;
+    }
+
+    struct stat bound_st{};
+    ::lstat(socket_path.c_str(), &bound_st);
+
+    std::signal(SIGPIPE, SIG_IGN);  // a client can go away before its response is written
+    printInfo("Listening on `{}`...", socket_path);
+
+    ThreadPool pool(job_count);
+    while (true) {
+        int fd = ::accept(listen_fd, nullptr, nullptr);
+        if (fd < 0) {
+            if (errno == EINTR || errno == ECONNABORTED) { continue; }
+            printError("could not accept connection: {}", std::strerror(errno));
+            break;
+        }
+        pool.submit([fd, &handler] {
+            handleConnection(fd, handler);
+            ::close(fd);
+        });
+    }
+
+    ::close(listen_fd);
+    removeSocket(socket_path, &bound_st);
+    return false;
+#endif
+}
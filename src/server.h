@@ -0,0 +1,28 @@
+#pragma once
+
+#include "formatters.h"
+#include "input_files.h"
+
+#include <functional>
+#include <optional>
+
+// A request of the server mode. On the wire it is a list of arguments, one per line, which is ended with an empty
+// line, then the text to fix follows if `--text` is given; the client shuts down writing after the request. The
+// arguments are the fixing options of the command line and one file name. Without `--text` the file is read, with
+// it the file name is used only to resolve includes and to tell headers.
+//
+// The response is a line `<status> <messages size> <text size>`, then messages and the fixed text follow. The status
+// is 0 on success and 1 on failure or if the file needs fixing in check mode; the text is empty in check mode.
+struct ServerRequest {
+    FormattingParameters params;
+    LineRanges line_ranges;
+    std::string file_name;
+    std::optional<std::string> text;
+};
+
+// Handles a request, returns `false` on failure; messages printed by the handler are sent to the client
+using ServerRequestHandler = std::function<bool(const ServerRequest& request, std::string& fixed_text)>;
+
+// Serves requests on Unix domain socket `socket_path`, one request per connection, `job_count` of them in parallel;
+// returns `false` only on failure
+bool serve(const std::string& socket_path, unsigned job_count, const ServerRequestHandler& handler);
@@ -0,0 +1,63 @@
+#include "stats.h"
+
+#include <uxs/format.h>
+
+#if defined(_WIN32)
+#    define WIN32_LEAN_AND_MEAN
+#    include <windows.h>
+#else
+#    include <time.h>
+#endif
+
+RunStats* g_run_stats = nullptr;
+
+namespace {
+constexpr std::array<std::string_view, static_cast<unsigned>(RunStats::Phase::kCount)> kPhaseNames = {
+    "read", "include_scan", "fixing", "write"};
+constexpr std::array<std::string_view, static_cast<unsigned>(RunStats::Counter::kCount)> kCounterNames = {
+    "files", "files_refixed", "bytes", "tokens", "headers_scanned",
+    "headers_replayed", "ids_renamed", "include_probes", "output_bytes"};
+
+double toMs(std::chrono::nanoseconds time) { return 1e-6 * static_cast<double>(time.count()); }
+}  // namespace
+
+std::chrono::nanoseconds getThreadCpuTime() {
+#if defined(_WIN32)
+    FILETIME creation_time, exit_time, kernel_time, user_time;
+    if (!::GetThreadTimes(::GetCurrentThread(), &creation_time, &exit_time, &kernel_time, &user_time)) { return {}; }
+    auto to_ticks = [](const FILETIME& t) { return (std::uint64_t{t.dwHighDateTime} << 32) | t.dwLowDateTime; };
+    return std::chrono::nanoseconds(100 * (to_ticks(kernel_time) + to_ticks(user_time)));  // in 100 ns ticks
+#else
+    timespec ts{};
+    if (::clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) { return {}; }
+    return std::chrono::seconds(ts.tv_sec) + std::chrono::nanoseconds(ts.tv_nsec);
+#endif
+}
+
+std::string RunStats::format(std::chrono::nanoseconds wall_time) const {
+    std::string s = uxs::format("{:<20}{:>12}{:>12}\n", "phase", "wall, ms", "cpu, ms");
+    for (unsigned n = 0; n != phase_times_.size(); ++n) {
+        s += uxs::format("{:<20}{:>12.1f}{:>12.1f}\n", kPhaseNames[n],
+                         toMs(std::chrono::nanoseconds(phase_times_[n].wall.load())),
+                         toMs(std::chrono::nanoseconds(phase_times_[n].cpu.load())));
+    }
+    s += uxs::format("{:<20}{:>12.1f}\n", "total", toMs(wall_time));
+    for (unsigned n = 0; n != counters_.size(); ++n) {
+        s += uxs::format("{:<20}{:>12}\n", kCounterNames[n], counters_[n].load());
+    }
+    return s;
+}
+
+std::string RunStats::formatJson(std::chrono::nanoseconds wall_time) const {
+    std::string s = uxs::format("{{\"wall_ms\": {:.3f}, \"phases\": {{", toMs(wall_time));
+    for (unsigned n = 0; n != phase_times_.size(); ++n) {
+        s += uxs::format("{}\"{}\": {{\"wall_ms\": {:.3f}, \"cpu_ms\": {:.3f}}}", n ? ", " : "", kPhaseNames[n],
+                         toMs(std::chrono::nanoseconds(phase_times_[n].wall.load())),
+                         toMs(std::chrono::nanoseconds(phase_times_[n].cpu.load())));
+    }
+    s += "}";
+    for (unsigned n = 0; n != counters_.size(); ++n) {
+        s += uxs::format(", \"{}\": {}", kCounterNames[n], counters_[n].load());
+    }
+    return s += "}\n";
+}
@@ -0,0 +1,80 @@
+#pragma once
+
+#include <array>
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <string_view>
+
+// Phase times and counters of a run aggregated over all files; they are collected only while `g_run_stats` is set
+class RunStats {
+ public:
+    enum class Phase : std::uint8_t { kRead = 0, kIncludeScan, kFixing, kWrite, kCount };
+    enum class Counter : std::uint8_t {
+        kFiles = 0,
+        kFilesRefixed,
+        kBytes,
+        kTokens,
+        kHeadersScanned,
+        kHeadersReplayed,
+        kIdsRenamed,
+        kIncludeProbes,
+        kOutputBytes,
+        kCount,
+    };
+
+    void addPhaseTime(Phase phase, std::chrono::nanoseconds wall_time, std::chrono::nanoseconds cpu_time) {
+        auto& times = phase_times_[static_cast<unsigned>(phase)];
+        times.wall.fetch_add(wall_time.count(), std::memory_order_relaxed);
+        times.cpu.fetch_add(cpu_time.count(), std::memory_order_relaxed);
+    }
+    void add(Counter counter, std::uint64_t n = 1) {
+        counters_[static_cast<unsigned>(counter)].fetch_add(n, std::memory_order_relaxed);
+    }
+    std::uint64_t get(Counter counter) const { return counters_[static_cast<unsigned>(counter)]; }
+
+    // Phase times are summed over threads, so they can exceed `wall_time` of the run
+    std::string format(std::chrono::nanoseconds wall_time) const;
+    std::string formatJson(std::chrono::nanoseconds wall_time) const;
+
+ private:
+    struct PhaseTimes {
+        std::atomic<std::int64_t> wall{0};
+        std::atomic<std::int64_t> cpu{0};
+    };
+
+    std::array<PhaseTimes, static_cast<unsigned>(Phase::kCount)> phase_times_;
+    std::array<std::atomic<std::uint64_t>, static_cast<unsigned>(Counter::kCount)> counters_{};
+};
+
+extern RunStats* g_run_stats;
+
+// CPU time consumed by the calling thread
+std::chrono::nanoseconds getThreadCpuTime();
+
+// Adds the time of its scope to a phase
+class PhaseTimer {
+ public:
+    explicit PhaseTimer(RunStats::Phase phase) : phase_(phase) {
+        if (!g_run_stats) { return; }
+        wall_start_ = std::chrono::steady_clock::now();
+        cpu_start_ = getThreadCpuTime();
+    }
+    ~PhaseTimer() {
+        if (!g_run_stats) { return; }
+        g_run_stats->addPhaseTime(phase_, std::chrono::steady_clock::now() - wall_start_,
+                                  getThreadCpuTime() - cpu_start_);
+    }
+    PhaseTimer(const PhaseTimer&) = delete;
+    PhaseTimer& operator=(const PhaseTimer&) = delete;
+
+ private:
+    RunStats::Phase phase_;
+    std::chrono::steady_clock::time_point wall_start_;
+    std::chrono::nanoseconds cpu_start_{};
+};
+
+inline void countStat(RunStats::Counter counter, std::uint64_t n = 1) {
+    if (g_run_stats) { g_run_stats->add(counter, n); }
+}
@@ -0,0 +1,164 @@
+#include "text_output.h"
+
+#include <algorithm>
+#include <string>
+
+#if defined(_WIN32)
+#    include <uxs/io/filebuf.h>
+#else
+#    include <fcntl.h>
+#    include <sys/uio.h>
+#    include <unistd.h>
+
+#    include <cerrno>
+#    include <climits>
+#endif
+
+void TextOutput::append(std::string_view s) {
+    if (s.empty()) { return; }
+
+    if (is_check_only_) {
+        if (is_changed_) { return; }
+        const char* source_next = source_.data() + size_;
+        if (s.data() == source_next && s.size() <= source_.size() - size_) {
+            size_ += s.size();
+            return;
+        }
+        std::size_t sz = std::min(s.size(), source_.size() - size_);
+        auto [p, _] = std::mismatch(s.begin(), s.begin() + sz, source_next);
+        size_ += static_cast<std::size_t>(p - s.begin());
+        is_changed_ = p != s.end();
+        return;
+    }
+
+    size_ += s.size();
+
+    // The source position following the last piece
+    const char* source_last = source_.data() + source_.size();
+    const char* source_next = source_.data();
+    if (!pieces_.empty()) {
+        source_next = isSourcePiece(pieces_.back()) ? pieces_.back().first + pieces_.back().size : nullptr;
+    }
+
+    if (s.data() >= source_.data() && s.data() + s.size() <= source_last) {
+        if (s.data() == source_next && !pieces_.empty()) {
+            pieces_.back().size += s.size();
+        } else {
+            pieces_.emplace_back(Piece{s.data(), s.size()});
+        }
+        return;
+    }
+
+    // Inserted text can still be the same as the next bytes of the source
+    if (source_next && static_cast<std::size_t>(source_last - source_next) >= s.size() &&
+        std::equal(s.begin(), s.end(), source_next)) {
+        if (!pieces_.empty()) {
+            pieces_.back().size += s.size();
+        } else {
+            pieces_.emplace_back(Piece{source_next, s.size()});
+        }
+        return;
+    }
+
+    if (!pieces_.empty() && !isSourcePiece(pieces_.back()) &&
+        pieces_.back().first + pieces_.back().size == chunk_pos_ &&
+        static_cast<std::size_t>(chunk_end_ - chunk_pos_) >= s.size()) {
+        chunk_pos_ = std::copy(s.begin(), s.end(), chunk_pos_);
+        pieces_.back().size += s.size();
+        return;
+    }
+
+    char* fragment = allocFragment(s.size());
+    std::copy(s.begin(), s.end(), fragment);
+    pieces_.emplace_back(Piece{fragment, s.size()});
+}
+
+bool TextOutput::isEqualToSource() const {
+    if (is_check_only_) { return !is_changed_ && size_ == source_.size(); }
+    if (size_ != source_.size()) { return false; }
+    const char* p = source_.data();
+    for (const auto& piece : pieces_) {
+        if (piece.first != p && !std::equal(piece.first, piece.first + piece.size, p)) { return false; }
+        p += piece.size;
+    }
+    return true;
+}
+
+std::size_t TextOutput::findFirstChange() const {
+    if (is_check_only_) { return size_; }
+    std::size_t offset = 0;
+    for (const auto& piece : pieces_) {
+        std::size_t sz = std::min(piece.size, source_.size() - offset);
+        auto [p, _] = std::mismatch(piece.first, piece.first + sz, source_.data() + offset);
+        offset += static_cast<std::size_t>(p - piece.first);
+        if (p != piece.first + piece.size) { break; }
+    }
+    return offset;
+}
+
+std::string TextOutput::str() const {
+    std::string text;
+    text.reserve(size_);
+    for (const auto& piece : pieces_) { text.append(piece.first, piece.size); }
+    return text;
+}
+
+char* TextOutput::allocFragment(std::size_t sz) {
+    if (sz > kChunkSize / 4) { return chunks_.emplace_back(std::make_unique<char[]>(sz)).get(); }
+    if (static_cast<std::size_t>(chunk_end_ - chunk_pos_) < sz) {
+        chunk_pos_ = chunks_.emplace_back(std::make_unique<char[]>(kChunkSize)).get();
+        chunk_end_ = chunk_pos_ + kChunkSize;
+    }
+    char* fragment = chunk_pos_;
+    chunk_pos_ += sz;
+    return fragment;
+}
+
+#if defined(_WIN32)
+
+bool TextOutput::writeFile(const std::filesystem::path& file_path) const {
+    uxs::filebuf ofile(file_path.c_str(), "w");
+    if (!ofile) { return false; }
+    for (const auto& piece : pieces_) { ofile.write(std::string_view(piece.first, piece.size)); }
+    return true;
+}
+
+#else  // defined(_WIN32)
+
+bool TextOutput::writeFile(const std::filesystem::path& file_path) const {
+#    if defined(IOV_MAX)
+    constexpr std::size_t kMaxIovCount = IOV_MAX;
+#    else
+    constexpr std::size_t kMaxIovCount = 16;
+#    endif
+
+    int fd = ::open(file_path.c_str(), O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0666);
+    if (fd < 0) { return false; }
+
+    std::vector<iovec> iov;
+    iov.reserve(std::min(pieces_.size(), kMaxIovCount));
+    std::size_t n_piece = 0, offset = 0;  // the first piece to write and the count of its bytes already written
+    while (n_piece != pieces_.size()) {
+        iov.clear();
+        for (std::size_t n = n_piece; n != pieces_.size() && iov.size() != kMaxIovCount; ++n) {
+            std::size_t skip = n == n_piece ? offset : 0;
+            iov.emplace_back(iovec{const_cast<char*>(pieces_[n].first) + skip, pieces_[n].size - skip});
+        }
+        auto n_written = ::writev(fd, iov.data(), static_cast<int>(iov.size()));
+        if (n_written < 0) {
+            if (errno == EINTR) { continue; }
+            ::close(fd);
+            return false;
+        }
+        for (auto left = static_cast<std::size_t>(n_written); n_piece != pieces_.size(); ++n_piece, offset = 0) {
+            if (left < pieces_[n_piece].size - offset) {
+                offset += left;
+                break;
+            }
+            left -= pieces_[n_piece].size - offset;
+        }
+    }
+    return ::close(fd) == 0;
+}
+
+#endif  // defined(_WIN32)
@@ -0,0 +1,49 @@
+#pragma once
+
+#include <filesystem>
+#include <memory>
+#include <span>
+#include <string_view>
+#include <vector>
+
+// Output text as a sequence of pieces: spans of the source text, which are referenced, and inserted fragments, which
+// are copied. Appending the bytes which follow the previous source piece just extends this piece, so the output of an
+// unchanged text is a single piece. In check-only mode nothing is stored, the output is only compared with the source.
+class TextOutput {
+ public:
+    explicit TextOutput(std::span<const char> source, bool is_check_only = false)
+        : source_(source), is_check_only_(is_check_only) {}
+    TextOutput(const TextOutput&) = delete;
+    TextOutput& operator=(const TextOutput&) = delete;
+
+    std::size_t getSize() const { return size_; }
+    bool isChanged() const { return is_changed_; }  // for check-only mode
+    void append(std::string_view s);
+    bool isEqualToSource() const;
+    std::size_t findFirstChange() const;
+    std::string str() const;
+
+    bool writeFile(const std::filesystem::path& file_path) const;
+
+ private:
+    static constexpr std::size_t kChunkSize = 4096;
+
+    struct Piece {
+        const char* first;
+        std::size_t size;
+    };
+
+    std::span<const char> source_;
+    bool is_check_only_;
+    bool is_changed_ = false;
+    std::vector<Piece> pieces_;
+    std::size_t size_ = 0;
+    std::vector<std::unique_ptr<char[]>> chunks_;
+    char* chunk_pos_ = nullptr;
+    char* chunk_end_ = nullptr;
+
+    bool isSourcePiece(const Piece& piece) const {
+        return piece.first >= source_.data() && piece.first < source_.data() + source_.size();
+    }
+    char* allocFragment(std::size_t sz);
+};
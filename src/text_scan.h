@@ -0,0 +1,94 @@
+#pragma once
+
+#include <bit>
+#include <cstddef>
+#include <cstdint>
+
+#if defined(__AVX2__)
+#    include <immintrin.h>
+#    define TEXT_SCAN_SIMD_WIDTH 32
+#elif defined(__SSE2__) || defined(_M_X64) || (defined(_M_IX86_FP) && _M_IX86_FP >= 2)
+#    include <emmintrin.h>
+#    define TEXT_SCAN_SIMD_WIDTH 16
+#endif
+
+// Character run scanners: process a block of characters at once where SIMD instructions are available. Unaligned loads
+// never cross `last`, so the text needs no padding.
+namespace text_scan {
+
+#if TEXT_SCAN_SIMD_WIDTH == 32
+
+using Vec = __m256i;
+inline Vec load(const char* p) { return _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p)); }
+inline Vec splat(char ch) { return _mm256_set1_epi8(ch); }
+inline Vec eq(Vec a, Vec b) { return _mm256_cmpeq_epi8(a, b); }
+inline Vec gt(Vec a, Vec b) { return _mm256_cmpgt_epi8(a, b); }
+inline Vec vor(Vec a, Vec b) { return _mm256_or_si256(a, b); }
+inline Vec vand(Vec a, Vec b) { return _mm256_and_si256(a, b); }
+inline std::uint32_t mask(Vec v) { return static_cast<std::uint32_t>(_mm256_movemask_epi8(v)); }
+constexpr std::uint32_t kFullMask = 0xffffffff;
+
+#elif TEXT_SCAN_SIMD_WIDTH == 16
+
+using Vec = __m128i;
+inline Vec load(const char* p) { return _mm_loadu_si128(reinterpret_cast<const __m128i*>(p)); }
+inline Vec splat(char ch) { return _mm_set1_epi8(ch); }
+inline Vec eq(Vec a, Vec b) { return _mm_cmpeq_epi8(a, b); }
+inline Vec gt(Vec a, Vec b) { return _mm_cmpgt_epi8(a, b); }
+inline Vec vor(Vec a, Vec b) { return _mm_or_si128(a, b); }
+inline Vec vand(Vec a, Vec b) { return _mm_and_si128(a, b); }
+inline std::uint32_t mask(Vec v) { return static_cast<std::uint32_t>(_mm_movemask_epi8(v)); }
+constexpr std::uint32_t kFullMask = 0xffff;
+
+#endif
+
+inline bool isBlank(char ch) { return ch == ' ' || ch == '\t'; }
+inline bool isIdChar(char ch) {
+    return (ch >= 'a' && ch <= 'z') || (ch >= 'A' && ch <= 'Z') || (ch >= '0' && ch <= '9') || ch == '_';
+}
+
+// Skips spaces and tabs
+inline const char* skipBlanks(const char* first, const char* last) {
+#if defined(TEXT_SCAN_SIMD_WIDTH)
+    for (; last - first >= TEXT_SCAN_SIMD_WIDTH; first += TEXT_SCAN_SIMD_WIDTH) {
+        Vec v = load(first);
+        std::uint32_t stop = ~mask(vor(eq(v, splat(' ')), eq(v, splat('\t')))) & kFullMask;
+        if (stop) { return first + std::countr_zero(stop); }
+    }
+#endif
+    while (first != last && isBlank(*first)) { ++first; }
+    return first;
+}
+
+// Skips letters, digits and underscores
+inline const char* skipIdChars(const char* first, const char* last) {
+#if defined(TEXT_SCAN_SIMD_WIDTH)
+    for (; last - first >= TEXT_SCAN_SIMD_WIDTH; first += TEXT_SCAN_SIMD_WIDTH) {
+        Vec v = load(first);
+        // Bytes >= 0x80 are negative, so they are out of both ranges
+        Vec lower = vor(v, splat(0x20));
+        Vec is_letter = vand(gt(lower, splat('a' - 1)), gt(splat('z' + 1), lower));
+        Vec is_digit = vand(gt(v, splat('0' - 1)), gt(splat('9' + 1), v));
+        std::uint32_t stop = ~mask(vor(vor(is_letter, is_digit), eq(v, splat('_')))) & kFullMask;
+        if (stop) { return first + std::countr_zero(stop); }
+    }
+#endif
+    while (first != last && isIdChar(*first)) { ++first; }
+    return first;
+}
+
+// Finds the first occurrence of any of given characters
+template<typename... Chars>
+const char* findFirstOf(const char* first, const char* last, Chars... chs) {
+#if defined(TEXT_SCAN_SIMD_WIDTH)
+    for (; last - first >= TEXT_SCAN_SIMD_WIDTH; first += TEXT_SCAN_SIMD_WIDTH) {
+        Vec v = load(first);
+        std::uint32_t found = (mask(eq(v, splat(chs))) | ...);
+        if (found) { return first + std::countr_zero(found); }
+    }
+#endif
+    while (first != last && ((*first != chs) && ...)) { ++first; }
+    return first;
+}
+
+}  // namespace text_scan
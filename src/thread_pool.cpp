@@ -0,0 +1,76 @@
+#include "thread_pool.h"
+
+ThreadPool::ThreadPool(unsigned thread_count) {
+    workers_.reserve(std::max(1u, thread_count));
+    for (unsigned n = 0; n != std::max(1u, thread_count); ++n) { workers_.emplace_back(std::make_unique<Worker>()); }
+    for (std::size_t n = 0; n != workers_.size(); ++n) {
+        workers_[n]->thread = std::thread([this, n] { run(n); });
+    }
+}
+
+ThreadPool::~ThreadPool() {
+    {
+        std::lock_guard lock(mutex_);
+        stop_ = true;
+    }
+    cv_.notify_all();
+    for (auto& worker : workers_) { worker->thread.join(); }
+}
+
+void ThreadPool::push(std::function<void()> task) {
+    std::size_t index = 0;
+    {
+        std::lock_guard lock(mutex_);
+        index = next_worker_++ % workers_.size();
+        ++pending_count_;
+    }
+    {
+        std::lock_guard lock(workers_[index]->mutex);
+        workers_[index]->tasks.emplace_back(std::move(task));
+    }
+    cv_.notify_one();
+}
+
+bool ThreadPool::popTask(std::size_t index, std::function<void()>& task) {
+    // Take the oldest task from own queue first, then steal the newest one from the others
+    {
+        auto& own = *workers_[index];
+        std::lock_guard lock(own.mutex);
+        if (!own.tasks.empty()) {
+            task = std::move(own.tasks.front());
+            own.tasks.pop_front();
+            return true;
+        }
+    }
+    for (std::size_t n = 1; n != workers_.size(); ++n) {
+        auto& victim = *workers_[(index + n) % workers_.size()];
+        std::lock_guard lock(victim.mutex);
+        if (!victim.tasks.empty()) {
+            task = std::move(victim.tasks.back());
+            victim.tasks.pop_back();
+            return true;
+        }
+    }
+    return false;
+}
+
+void ThreadPool::run(std::size_t index) {
+    std::function<void()> task;
+    while (true) {
+        {
+            std::unique_lock lock(mutex_);
+            cv_.wait(lock, [this] { return pending_count_ != 0 || stop_; });
+            if (pending_count_ == 0) { return; }
+        }
+        if (popTask(index, task)) {
+            {
+                std::lock_guard lock(mutex_);
+                --pending_count_;
+            }
+            task();
+            task = nullptr;
+        } else {
+            std::this_thread::yield();
+        }
+    }
+}
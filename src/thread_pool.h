@@ -0,0 +1,46 @@
+#pragma once
+
+#include <condition_variable>
+#include <deque>
+#include <functional>
+#include <future>
+#include <memory>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+class ThreadPool {
+ public:
+    explicit ThreadPool(unsigned thread_count);
+    ~ThreadPool();
+    ThreadPool(const ThreadPool&) = delete;
+    ThreadPool& operator=(const ThreadPool&) = delete;
+
+    unsigned getThreadCount() const { return static_cast<unsigned>(workers_.size()); }
+
+    template<typename Func>
+    auto submit(Func&& func) -> std::future<decltype(func())> {
+        auto task = std::make_shared<std::packaged_task<decltype(func())()>>(std::forward<Func>(func));
+        auto result = task->get_future();
+        push([task = std::move(task)] { (*task)(); });
+        return result;
+    }
+
+ private:
+    struct Worker {
+        std::mutex mutex;
+        std::deque<std::function<void()>> tasks;
+        std::thread thread;
+    };
+
+    std::vector<std::unique_ptr<Worker>> workers_;
+    std::mutex mutex_;
+    std::condition_variable cv_;
+    std::size_t pending_count_ = 0;
+    std::size_t next_worker_ = 0;
+    bool stop_ = false;
+
+    void push(std::function<void()> task);
+    bool popTask(std::size_t index, std::function<void()>& task);
+    void run(std::size_t index);
+};
@@ -0,0 +1,58 @@
+#include "trace.h"
+
+#if defined(USE_TRACING)
+
+#    include <uxs/format.h>
+
+#    include <fstream>
+
+Tracer* g_tracer = nullptr;
+
+namespace {
+thread_local unsigned t_thread_id = 0;  // 0 until the thread adds its first span
+
+std::string escapeJson(std::string_view s) {
+    std::string result;
+    result.reserve(s.size());
+    for (char ch : s) {
+        if (ch == '"' || ch == '\\') {
+            (result += '\\') += ch;
+        } else if (static_cast<unsigned char>(ch) < 0x20) {
+            result += uxs::format("\\u{:04x}", static_cast<unsigned>(ch));
+        } else {
+            result += ch;
+        }
+    }
+    return result;
+}
+}  // namespace
+
+void Tracer::addSpan(std::string_view name, std::string detail, std::chrono::microseconds start_time,
+                     std::chrono::microseconds duration) {
+    std::lock_guard lock(mutex_);
+    if (!t_thread_id) { t_thread_id = ++thread_count_; }
+    spans_.push_back(Span{name, std::move(detail), t_thread_id, start_time, duration});
+}
+
+bool Tracer::writeFile(const std::filesystem::path& file_path) const {
+    std::lock_guard lock(mutex_);
+    std::ofstream out(file_path);
+    if (!out) { return false; }
+    out << "{\"traceEvents\": [\n";
+    out << R"({"name": "process_name", "ph": "M", "pid": 1, "args": {"name": "code-format"}})";
+    for (unsigned n = 1; n <= thread_count_; ++n) {
+        out << uxs::format(",\n{{\"name\": \"thread_name\", \"ph\": \"M\", \"pid\": 1, \"tid\": {}, "
+                           "\"args\": {{\"name\": \"thread {}\"}}}}",
+                           n, n);
+    }
+    for (const auto& span : spans_) {
+        out << uxs::format(",\n{{\"name\": \"{}\", \"ph\": \"X\", \"pid\": 1, \"tid\": {}, \"ts\": {}, \"dur\": {}",
+                           span.name, span.thread_id, span.start_time.count(), span.duration.count());
+        if (!span.detail.empty()) { out << uxs::format(", \"args\": {{\"detail\": \"{}\"}}", escapeJson(span.detail)); }
+        out << '}';
+    }
+    out << "\n]}\n";
+    return !!out;
+}
+
+#endif  // defined(USE_TRACING)
@@ -0,0 +1,78 @@
+#pragma once
+
+// Spans of Chrome trace events (`chrome://tracing`, Perfetto) written by `--trace-file`. Without `USE_TRACING`
+// `TRACE_SPAN` expands to nothing and its arguments are not evaluated.
+#if defined(USE_TRACING)
+
+#    include <chrono>
+#    include <filesystem>
+#    include <mutex>
+#    include <string>
+#    include <string_view>
+#    include <type_traits>
+#    include <vector>
+
+class Tracer {
+ public:
+    Tracer() : start_time_(std::chrono::steady_clock::now()) {}
+
+    std::chrono::microseconds getTime() const {
+        return std::chrono::duration_cast<std::chrono::microseconds>(std::chrono::steady_clock::now() - start_time_);
+    }
+    void addSpan(std::string_view name, std::string detail, std::chrono::microseconds start_time,
+                 std::chrono::microseconds duration);
+    bool writeFile(const std::filesystem::path& file_path) const;
+
+ private:
+    struct Span {
+        std::string_view name;  // always a literal
+        std::string detail;
+        unsigned thread_id;
+        std::chrono::microseconds start_time;
+        std::chrono::microseconds duration;
+    };
+
+    std::chrono::steady_clock::time_point start_time_;
+    mutable std::mutex mutex_;
+    std::vector<Span> spans_;
+    unsigned thread_count_ = 0;
+};
+
+extern Tracer* g_tracer;
+
+// Adds a span of its scope to `g_tracer` if it is set; `detail` is shown as an argument of the span
+class TraceSpan {
+ public:
+    explicit TraceSpan(std::string_view name) : name_(name) {
+        if (g_tracer) { start_time_ = g_tracer->getTime(); }
+    }
+    template<typename Detail>
+    TraceSpan(std::string_view name, const Detail& detail) : TraceSpan(name) {
+        if (!g_tracer) { return; }
+        if constexpr (std::is_same_v<Detail, std::filesystem::path>) {
+            detail_ = detail.generic_string();
+        } else {
+            detail_ = detail;
+        }
+    }
+    ~TraceSpan() {
+        if (g_tracer) { g_tracer->addSpan(name_, std::move(detail_), start_time_, g_tracer->getTime() - start_time_); }
+    }
+    TraceSpan(const TraceSpan&) = delete;
+    TraceSpan& operator=(const TraceSpan&) = delete;
+
+ private:
+    std::string_view name_;
+    std::string detail_;
+    std::chrono::microseconds start_time_{};
+};
+
+#    define TRACE_CONCAT_IMPL(a, b) a##b
+#    define TRACE_CONCAT(a, b)      TRACE_CONCAT_IMPL(a, b)
+#    define TRACE_SPAN(...)         TraceSpan TRACE_CONCAT(trace_span_, __LINE__)(__VA_ARGS__)
+
+#else  // defined(USE_TRACING)
+
+#    define TRACE_SPAN(...) ((void)0)
+
+#endif  // defined(USE_TRACING)
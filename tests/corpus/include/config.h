@@ -0,0 +1,5 @@
+#pragma once
+
+// Limits shared by the corpus headers
+
+constexpr int kMaxItemCount = 16;
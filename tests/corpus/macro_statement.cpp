@@ -0,0 +1,9 @@
+// The whitespace before the end of a macro body is dropped when a single statement reaches it
+
+#define RETURN_IF(cond) if (cond) return 	
+#define LOOP_ONCE do	
+
+int f(int a) {
+    RETURN_IF(a) 0;
+    return 1;
+}
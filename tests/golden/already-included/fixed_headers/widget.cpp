@@ -0,0 +1,7 @@
+// `extra.h` is already included by `features.h` once `options.h` is fixed by `--fix-id-naming`
+
+#include "options.h"
+#include "features.h"
+#include "extra.h"
+
+int getExtraValue(const Extra& extra) { return extra.value; }
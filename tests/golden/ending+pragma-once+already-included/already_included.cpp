@@ -0,0 +1,10 @@
+// Headers which are already included directly or by other headers are removed by `--remove-already-included`
+
+#include "include/list.h"
+#include "pragma_once.h"
+
+int countItems(const List* list) {
+    int count = 0;
+    for (const List* p = list; p && count < kMaxItemCount; p = p->next) { ++count; }
+    return count;
+}
@@ -0,0 +1,5 @@
+// The file ends with several empty lines, `--fix-file-ending` leaves one new-line symbol
+
+int square(int x) { return x * x; }
+
+int cube(int x) { return x * square(x); }
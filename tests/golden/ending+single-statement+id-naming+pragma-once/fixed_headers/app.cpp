@@ -0,0 +1,5 @@
+// The scan of `options.h` made for this file must not be replayed for `widget.cpp` after the header is fixed
+
+#include "options.h"
+
+int main() { return 0; }
@@ -0,0 +1,40 @@
+// Single-statement blocks are enclosed in brackets by `--fix-single-statement`
+
+int clamp(int v, int lo, int hi) {
+    if (v < lo) { return lo; } else if (v > hi) { return hi; } else { return v; }
+}
+
+int sum(const int* data, int count) {
+    int total = 0;
+    for (int n = 0; n < count; ++n) {
+        total += data[n];
+                  }
+    return total;
+}
+
+int countDigits(unsigned v) {
+    int count = 0;
+    do { ++count; } while ((v /= 10) != 0);
+    return count;
+}
+
+void skipSpaces(const char*& p) {
+    while (*p == ' ' || *p == '\t') { ++p;  // comment after the statement
+                                 }
+}
+
+int sign(int v) {
+    if (v > 0) {
+        return 1;
+    } else if (v < 0) {  // negative
+        return -1;
+                 }
+    return 0;
+}
+
+int nested(int a, int b) {
+    if (a) {
+        if (b) { return 1; } else { return 2; }
+                          }
+    return 0;
+}
@@ -0,0 +1,5 @@
+#pragma once
+
+#ifdef use_extra
+#    include "extra.h"
+#endif
\ No newline at end of file
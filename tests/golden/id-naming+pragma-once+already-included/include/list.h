@@ -0,0 +1,11 @@
+#ifndef LIST_H
+#define LIST_H
+
+#include "config.h"
+
+struct List {
+    List* next = nullptr;
+    int value = 0;
+};
+
+#endif  // LIST_H
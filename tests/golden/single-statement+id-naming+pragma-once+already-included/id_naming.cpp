@@ -0,0 +1,27 @@
+// Identifiers are renamed to `snake_case` and members to `snake_case_` by `--fix-id-naming`
+
+#define MAKE_PAIR(first_value, second_value) {first_value, second_value}
+
+struct Point {
+    int x_coord_ = 0;
+    int y_coord_ = 0;
+};
+
+enum class Color { kRed = 0, kGreen, kBlue };
+
+int manhattanDistance(const Point& lhs_point, const Point& rhs_point) {
+    int delta_x = lhs_point.x_coord_ - rhs_point.x_coord_;
+    int delta_y = lhs_point.y_coord_ - rhs_point.y_coord_;
+    return (delta_x < 0 ? -delta_x : delta_x) + (delta_y < 0 ? -delta_y : delta_y);
+}
+
+int sumOfSquares(int item_count) {
+    int total_sum = 0;
+    for (int item_index = 1; item_index <= item_count; ++item_index) { total_sum += item_index * item_index; }
+    return total_sum;
+}
+
+const char* colorName(Color color) {
+    static const char* color_names_2[] = {"red", "green", "blue"};
+    return color_names_2[static_cast<int>(color)];
+}
@@ -0,0 +1,27 @@
+// Identifiers are renamed to `snake_case` and members to `snake_case_` by `--fix-id-naming`
+
+#define MAKE_PAIR(firstValue, secondValue) {firstValue, secondValue}
+
+struct Point {
+    int _xCoord = 0;
+    int _yCoord = 0;
+};
+
+enum class Color { kRed = 0, kGreen, kBlue };
+
+int manhattanDistance(const Point& lhsPoint, const Point& rhsPoint) {
+    int deltaX = lhsPoint._xCoord - rhsPoint._xCoord;
+    int deltaY = lhsPoint._yCoord - rhsPoint._yCoord;
+    return (deltaX < 0 ? -deltaX : deltaX) + (deltaY < 0 ? -deltaY : deltaY);
+}
+
+int sumOfSquares(int itemCount) {
+    int totalSum = 0;
+    for (int itemIndex = 1; itemIndex <= itemCount; ++itemIndex) { totalSum += itemIndex * itemIndex; }
+    return totalSum;
+}
+
+const char* colorName(Color color) {
+    static const char* colorNames2[] = {"red", "green", "blue"};
+    return colorNames2[static_cast<int>(color)];
+}
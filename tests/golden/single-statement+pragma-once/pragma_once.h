@@ -0,0 +1,14 @@
+// `--fix-pragma-once` puts `#pragma once` before the first significant line and removes it from other places,
+// headers with C-style include guards are kept as is
+
+#pragma once
+
+
+
+struct Range {
+    int first = 0;
+    int last = 0;
+};
+
+
+inline int getLength(const Range& r) { return r.last - r.first; }
@@ -0,0 +1,5 @@
+#pragma once
+
+struct Extra {
+    int value = 0;
+};